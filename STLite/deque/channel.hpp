@@ -0,0 +1,323 @@
+#ifndef SJTU_CHANNEL_HPP
+#define SJTU_CHANNEL_HPP
+
+#include "deque.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 201703L
+#define SJTU_CHANNEL_COROUTINES
+#include <coroutine>
+#include <optional>
+#endif
+
+namespace sjtu
+{
+/*
+ * Bounded FIFO channel between pipeline stages. push blocks while capacity() elements
+ * are queued and pop blocks while none are; push_n and pop_n move a whole batch under
+ * one lock and wake the other side once per batch rather than once per element, and
+ * pop_n returns everything available up to n. close() wakes every waiter: pushes fail
+ * from then on, pops drain what is left and then fail. With C++20 coroutines,
+ * co_await ch.pop() and co_await ch.push_async(x) suspend the coroutine instead of
+ * its thread; it is resumed on the thread of the operation that satisfies it.
+ */
+template <class T>
+class channel
+{
+	struct Waiter //a suspended coroutine
+	{
+		Waiter *next;
+		T *value; //pop: raw storage the element is moved into, push: the element to move out
+		bool ok;
+#ifdef SJTU_CHANNEL_COROUTINES
+		std::coroutine_handle<> handle;
+#endif
+		Waiter(T *v) : next(NULL), value(v), ok(false) {}
+	};
+	struct WaitList
+	{
+		Waiter *first, *last;
+		WaitList() : first(NULL), last(NULL) {}
+		bool empty() const { return first == NULL; }
+		void push(Waiter *w)
+		{
+			w->next = NULL;
+			if (last)
+				last->next = w;
+			else
+				first = w;
+			last = w;
+		}
+		Waiter *pop()
+		{
+			Waiter *w = first;
+			first = w->next;
+			if (first == NULL)
+				last = NULL;
+			return w;
+		}
+	};
+
+	mutable std::mutex lock; //guards everything below
+	std::condition_variable notEmpty;
+	std::condition_variable notFull;
+	deque<T> items;
+	size_t limit;
+	bool isClosed;
+	WaitList popWaiters;  //only while items is empty
+	WaitList pushWaiters; //only while items is full
+
+	/*
+	 * Hands queued elements to waiting pop coroutines and lets waiting push coroutines
+	 * into the room that frees. The satisfied waiters are collected in ready and
+	 * resumed by wake() once the lock is released.
+	 */
+	void settle(WaitList &ready)
+	{
+		for (;;)
+		{
+			if (!popWaiters.empty() && !items.empty())
+			{
+				Waiter *w = popWaiters.pop();
+				new (w->value) T(std::move(items.front()));
+				items.pop_front();
+				w->ok = true;
+				ready.push(w);
+			}
+			else if (!pushWaiters.empty() && items.size() < limit)
+			{
+				Waiter *w = pushWaiters.pop();
+				items.push_back(std::move(*w->value));
+				w->ok = true;
+				ready.push(w);
+			}
+			else
+				return;
+		}
+	}
+	static void wake(WaitList &ready)
+	{
+#ifdef SJTU_CHANNEL_COROUTINES
+		while (!ready.empty())
+			ready.pop()->handle.resume(); //the waiter lives in the coroutine frame, unlinked before it may go away
+#else
+		(void)ready; //nothing can be waiting without coroutines
+#endif
+	}
+	template <class U>
+	bool pushOne(U &&value)
+	{
+		WaitList ready;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			notFull.wait(guard, [&] { return isClosed || items.size() < limit; });
+			if (isClosed)
+				return false;
+			items.push_back(std::forward<U>(value));
+			settle(ready);
+		}
+		notEmpty.notify_one();
+		wake(ready);
+		return true;
+	}
+
+  public:
+	explicit channel(size_t capacity) : limit(capacity ? capacity : 1), isClosed(false) {}
+	channel(const channel &) = delete;
+	channel &operator=(const channel &) = delete;
+
+	bool push(const T &value) //false if the channel is closed
+	{
+		return pushOne(value);
+	}
+	bool push(T &&value)
+	{
+		return pushOne(std::move(value));
+	}
+	size_t push_n(const T *src, size_t n) //blocks until all n are queued, returns fewer only if the channel is closed
+	{
+		size_t done = 0;
+		while (done < n)
+		{
+			WaitList ready;
+			size_t k;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				notFull.wait(guard, [&] { return isClosed || items.size() < limit; });
+				if (isClosed)
+					break;
+				k = limit - items.size();
+				if (k > n - done)
+					k = n - done;
+				items.append(src + done, k);
+				settle(ready);
+			}
+			done += k;
+			if (k == 1)
+				notEmpty.notify_one();
+			else
+				notEmpty.notify_all();
+			wake(ready);
+		}
+		return done;
+	}
+
+	bool pop(T &out) //false once the channel is closed and drained
+	{
+		return pop_n(&out, 1) == 1;
+	}
+	size_t pop_n(T *dst, size_t n) //waits for at least one element, then takes up to n; 0 once closed and drained
+	{
+		if (n == 0)
+			return 0;
+		WaitList ready;
+		size_t k;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			notEmpty.wait(guard, [&] { return isClosed || !items.empty(); });
+			k = items.size() < n ? items.size() : n;
+			if (k == 0)
+				return 0;
+			items.for_each_segment(items.begin(), items.begin() + k, [&](T *first, T *last) {
+				for (; first != last; ++first)
+					*dst++ = std::move(*first);
+			});
+			items.pop_front_n(k);
+			settle(ready);
+		}
+		if (k == 1)
+			notFull.notify_one();
+		else
+			notFull.notify_all();
+		wake(ready);
+		return k;
+	}
+
+	void close()
+	{
+		WaitList ready;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			isClosed = true;
+			while (!popWaiters.empty())
+				ready.push(popWaiters.pop());
+			while (!pushWaiters.empty())
+				ready.push(pushWaiters.pop());
+		}
+		notEmpty.notify_all();
+		notFull.notify_all();
+		wake(ready);
+	}
+	bool closed() const
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return isClosed;
+	}
+	size_t size() const //a snapshot
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return items.size();
+	}
+	size_t capacity() const
+	{
+		return limit;
+	}
+
+#ifdef SJTU_CHANNEL_COROUTINES
+	class pop_awaiter
+	{
+		channel *ch;
+		alignas(T) unsigned char storage[sizeof(T)];
+		Waiter waiter;
+
+	  public:
+		explicit pop_awaiter(channel *c) : ch(c), waiter(reinterpret_cast<T *>(storage)) {}
+		pop_awaiter(const pop_awaiter &) = delete;
+		bool await_ready() const { return false; }
+		bool await_suspend(std::coroutine_handle<> h)
+		{
+			WaitList ready;
+			{
+				std::lock_guard<std::mutex> guard(ch->lock);
+				if (ch->items.empty() && !ch->isClosed)
+				{
+					waiter.handle = h;
+					ch->popWaiters.push(&waiter);
+					return true;
+				}
+				if (!ch->items.empty())
+				{
+					new (waiter.value) T(std::move(ch->items.front()));
+					ch->items.pop_front();
+					waiter.ok = true;
+					ch->settle(ready);
+				}
+			}
+			ch->notFull.notify_one();
+			wake(ready);
+			return false;
+		}
+		std::optional<T> await_resume() //empty once the channel is closed and drained
+		{
+			if (!waiter.ok)
+				return std::nullopt;
+			std::optional<T> res(std::move(*waiter.value));
+			waiter.value->~T();
+			return res;
+		}
+	};
+	class push_awaiter
+	{
+		channel *ch;
+		T value;
+		Waiter waiter;
+
+	  public:
+		push_awaiter(channel *c, T &&v) : ch(c), value(std::move(v)), waiter(&value) {}
+		push_awaiter(const push_awaiter &) = delete;
+		bool await_ready() const { return false; }
+		bool await_suspend(std::coroutine_handle<> h)
+		{
+			WaitList ready;
+			{
+				std::lock_guard<std::mutex> guard(ch->lock);
+				if (ch->isClosed)
+					return false;
+				if (ch->items.size() >= ch->limit)
+				{
+					waiter.handle = h;
+					ch->pushWaiters.push(&waiter);
+					return true;
+				}
+				ch->items.push_back(std::move(value));
+				waiter.ok = true;
+				ch->settle(ready);
+			}
+			ch->notEmpty.notify_one();
+			wake(ready);
+			return false;
+		}
+		bool await_resume() const //false if the channel is closed
+		{
+			return waiter.ok;
+		}
+	};
+
+	pop_awaiter pop()
+	{
+		return pop_awaiter(this);
+	}
+	push_awaiter push_async(T value)
+	{
+		return push_awaiter(this, std::move(value));
+	}
+#endif
+};
+
+} // namespace sjtu
+
+#endif
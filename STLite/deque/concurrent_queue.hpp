@@ -0,0 +1,370 @@
+#ifndef SJTU_CONCURRENT_QUEUE_HPP
+#define SJTU_CONCURRENT_QUEUE_HPP
+
+#include "deque.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <thread>
+#include <utility>
+
+namespace sjtu
+{
+/*
+ * Lock-free multi-producer multi-consumer FIFO queue over a linked list of fixed-size
+ * blocks, the same shape as the blocks of deque. Producers claim a slot of the tail
+ * block with a fetch_add and then publish it; consumers claim slots of the head
+ * block that producers have already claimed with a compare_exchange, so popping an
+ * empty queue claims nothing. A consumer that waits too long for a producer still
+ * writing its slot marks the slot abandoned and the producer enqueues the element
+ * again, so consumers never wait on producers. The one producer whose claim covers
+ * the first slot past the end of a block links the next block; the others that ran
+ * past the end wait for it rather than each allocating a block only to free it
+ * again. Blocks the head has moved past are
+ * reclaimed through epochs: each thread announces the epoch it entered an operation
+ * in, and a retired block is freed two epochs later, when no thread can still hold it.
+ * A thread's epoch record is given back when the thread exits and the next new thread
+ * takes it over, so the queue keeps one record per live thread at most.
+ * Elements of one producer stay in order except for abandoned slots of a batch.
+ */
+template <class T>
+class concurrent_queue
+{
+	static const size_t BlockSize = deque_block_size<T>::value;
+	static const int SPIN_LIMIT = 64; //yields a consumer waits on a claimed slot before abandoning it
+	enum : unsigned char
+	{
+		EMPTY,
+		FULL,
+		ABANDONED
+	};
+
+	struct Block
+	{
+		std::atomic<size_t> enq; //next slot producers claim, may run past BlockSize
+		char pad1[CACHE_LINE_BYTES - sizeof(std::atomic<size_t>)];
+		std::atomic<size_t> deq; //next slot consumers claim
+		char pad2[CACHE_LINE_BYTES - sizeof(std::atomic<size_t>)];
+		std::atomic<Block *> next;
+		Block *retired; //link in a limbo list
+		std::atomic<unsigned char> state[BlockSize];
+		alignas(T) unsigned char storage[sizeof(T) * BlockSize];
+		Block() : enq(0), pad1(), deq(0), pad2(), next(NULL), retired(NULL)
+		{
+			for (size_t i = 0; i < BlockSize; ++i)
+				state[i].store(EMPTY, std::memory_order_relaxed);
+		}
+		T *slot(size_t i) { return reinterpret_cast<T *>(storage) + i; }
+	};
+	struct Record //a thread's entry in the queue, reused once that thread exits
+	{
+		std::atomic<size_t> epoch; //(epoch << 1) | 1 inside an operation, 0 outside
+		Record *next; //in the queue's list, which only grows
+		std::atomic<bool> taken; //a live thread holds it
+		std::atomic<int> refs; //the queue, plus the thread holding it
+		size_t queue; //id of the queue
+		Record *nextOwned; //in the holding thread's list
+		Block *limbo[3]; //retired blocks by epoch % 3, inherited by the next holder
+		size_t limboEpoch[3];
+		explicit Record(size_t q) : epoch(0), next(NULL), taken(true), refs(2), queue(q), nextOwned(NULL)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				limbo[i] = NULL;
+				limboEpoch[i] = 0;
+			}
+		}
+	};
+	struct Owned //the records a thread holds, most recently used first; given back at thread exit
+	{
+		Record *list;
+		Owned() : list(NULL) {}
+		~Owned()
+		{
+			while (list)
+			{
+				Record *r = list;
+				list = r->nextOwned;
+				release(r);
+			}
+		}
+	};
+	class Guard //marks the calling thread as inside an operation
+	{
+		Record *rec;
+
+	  public:
+		explicit Guard(concurrent_queue &q) : rec(q.record())
+		{
+			rec->epoch.store((q.globalEpoch.load(std::memory_order_acquire) << 1) | 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+		~Guard() { rec->epoch.store(0, std::memory_order_release); }
+	};
+
+	std::atomic<Block *> head;
+	char pad1[CACHE_LINE_BYTES - sizeof(std::atomic<Block *>)];
+	std::atomic<Block *> tail;
+	char pad2[CACHE_LINE_BYTES - sizeof(std::atomic<Block *>)];
+	std::atomic<size_t> globalEpoch;
+	std::atomic<Record *> records;
+	size_t id; //what the records a thread holds are looked up by, addresses may be reused
+
+	static size_t nextId()
+	{
+		static std::atomic<size_t> counter(0);
+		return ++counter;
+	}
+	static void release(Record *r) //the holder lets go; the last of queue and holder frees it
+	{
+		r->taken.store(false, std::memory_order_release); //first, r may be freed right after the decrement
+		if (r->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			delete r; //the queue is gone, its limbo blocks with it
+	}
+	Record *record()
+	{
+		static thread_local Owned owned;
+		Record *r = owned.list;
+		if (r && r->queue == id)
+			return r;
+		for (Record **p = &owned.list; (r = *p) != NULL;)
+			if (r->queue == id) //move it to the front
+			{
+				*p = r->nextOwned;
+				r->nextOwned = owned.list;
+				owned.list = r;
+				return r;
+			}
+			else if (r->refs.load(std::memory_order_acquire) == 1) //only this thread holds it, its queue is gone
+			{
+				*p = r->nextOwned;
+				delete r;
+			}
+			else
+				p = &r->nextOwned;
+		for (r = records.load(std::memory_order_acquire); r; r = r->next) //take over the record of an exited thread
+		{
+			bool f = false;
+			if (!r->taken.load(std::memory_order_relaxed) && r->taken.compare_exchange_strong(f, true, std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				r->refs.fetch_add(1, std::memory_order_relaxed);
+				break;
+			}
+		}
+		if (r == NULL)
+		{
+			r = new Record(id);
+			r->next = records.load(std::memory_order_relaxed);
+			while (!records.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed))
+				;
+		}
+		r->nextOwned = owned.list;
+		owned.list = r;
+		return r;
+	}
+	static size_t clamp(size_t i) //enq runs past the end of a full block
+	{
+		return i < BlockSize ? i : BlockSize;
+	}
+	static void freeList(Block *b)
+	{
+		while (b)
+		{
+			Block *n = b->retired;
+			delete b;
+			b = n;
+		}
+	}
+	void retire(Block *b) //b is unreachable from head and tail
+	{
+		Record *rec = record();
+		size_t e = globalEpoch.load(std::memory_order_acquire);
+		if (rec->limboEpoch[e % 3] != e) //that list holds blocks of epoch e - 3 or older
+		{
+			freeList(rec->limbo[e % 3]);
+			rec->limbo[e % 3] = NULL;
+			rec->limboEpoch[e % 3] = e;
+		}
+		b->retired = rec->limbo[e % 3];
+		rec->limbo[e % 3] = b;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		for (Record *r = records.load(std::memory_order_acquire); r; r = r->next)
+		{
+			size_t v = r->epoch.load(std::memory_order_acquire);
+			if ((v & 1) && (v >> 1) != e)
+				return;
+		}
+		size_t cur = e;
+		globalEpoch.compare_exchange_strong(cur, e + 1, std::memory_order_acq_rel); //fails only if someone else advanced it
+		freeList(rec->limbo[(e + 2) % 3]); //retired at e - 1 or earlier, now two epochs old
+		rec->limbo[(e + 2) % 3] = NULL;
+	}
+	void appendBlock(Block *b, bool installer) //b is full: the installer links its successor, the others wait for that; then swing the tail
+	{
+		Block *n;
+		if (installer)
+		{
+			n = new Block;
+			b->next.store(n, std::memory_order_release);
+		}
+		else
+			while ((n = b->next.load(std::memory_order_acquire)) == NULL)
+				std::this_thread::yield();
+		tail.compare_exchange_strong(b, n, std::memory_order_acq_rel, std::memory_order_relaxed);
+	}
+	bool publish(Block *b, size_t i, T &value) //move value into a claimed slot, false if a consumer abandoned it
+	{
+		new (b->slot(i)) T(std::move(value));
+		unsigned char s = EMPTY;
+		if (b->state[i].compare_exchange_strong(s, FULL, std::memory_order_release, std::memory_order_relaxed))
+			return true;
+		value = std::move(*b->slot(i));
+		b->slot(i)->~T();
+		return false;
+	}
+	bool take(Block *b, size_t i, T &out) //slot i was claimed by a producer, wait for it a little
+	{
+		unsigned char s = b->state[i].load(std::memory_order_acquire);
+		for (int spin = 0; s == EMPTY && spin < SPIN_LIMIT; ++spin)
+		{
+			std::this_thread::yield();
+			s = b->state[i].load(std::memory_order_acquire);
+		}
+		if (s == EMPTY && b->state[i].compare_exchange_strong(s, ABANDONED, std::memory_order_acq_rel, std::memory_order_acquire))
+			return false;
+		out = std::move(*b->slot(i));
+		b->slot(i)->~T();
+		return true;
+	}
+	void pushValue(T &value)
+	{
+		for (;;)
+		{
+			Block *b = tail.load(std::memory_order_acquire);
+			size_t i = b->enq.fetch_add(1, std::memory_order_acq_rel);
+			if (i >= BlockSize)
+				appendBlock(b, i == BlockSize);
+			else if (publish(b, i, value))
+				return;
+		}
+	}
+
+  public:
+	concurrent_queue() : pad1(), pad2(), globalEpoch(0), records(NULL), id(nextId())
+	{
+		Block *b = new Block;
+		head.store(b, std::memory_order_relaxed);
+		tail.store(b, std::memory_order_relaxed);
+	}
+	concurrent_queue(const concurrent_queue &) = delete;
+	concurrent_queue &operator=(const concurrent_queue &) = delete;
+	~concurrent_queue() //no other thread may be using the queue
+	{
+		for (Block *b = head.load(std::memory_order_relaxed); b;)
+		{
+			size_t end = clamp(b->enq.load(std::memory_order_relaxed));
+			for (size_t i = b->deq.load(std::memory_order_relaxed); i < end; ++i)
+				if (b->state[i].load(std::memory_order_relaxed) == FULL)
+					b->slot(i)->~T();
+			Block *n = b->next.load(std::memory_order_relaxed);
+			delete b;
+			b = n;
+		}
+		for (Record *r = records.load(std::memory_order_relaxed); r;)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				freeList(r->limbo[i]);
+				r->limbo[i] = NULL;
+			}
+			Record *n = r->next;
+			if (r->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				delete r;
+			r = n; //a thread still holds it and frees it when it exits or next looks it up
+		}
+	}
+
+	void push(const T &value)
+	{
+		Guard guard(*this);
+		T tmp(value);
+		pushValue(tmp);
+	}
+	void push(T &&value)
+	{
+		Guard guard(*this);
+		pushValue(value);
+	}
+	void push_n(const T *src, size_t n) //claims a run of slots with one fetch_add per block
+	{
+		Guard guard(*this);
+		while (n)
+		{
+			Block *b = tail.load(std::memory_order_acquire);
+			size_t i = b->enq.fetch_add(n, std::memory_order_acq_rel);
+			if (i >= BlockSize)
+			{
+				appendBlock(b, i == BlockSize);
+				continue;
+			}
+			size_t k = clamp(n + i) - i;
+			if (k < n) //the claim ran past the end, so it covered slot BlockSize; link the next block before filling this one
+				appendBlock(b, true);
+			for (size_t j = 0; j < k; ++j)
+			{
+				T tmp(src[j]);
+				if (!publish(b, i + j, tmp))
+					pushValue(tmp);
+			}
+			src += k;
+			n -= k;
+		}
+	}
+
+	bool pop(T &out)
+	{
+		return pop_n(&out, 1) == 1;
+	}
+	size_t pop_n(T *dst, size_t n) //move up to n elements into dst, returns how many; stops early when the queue runs dry
+	{
+		Guard guard(*this);
+		size_t got = 0;
+		while (got < n)
+		{
+			Block *b = head.load(std::memory_order_acquire);
+			size_t d = b->deq.load(std::memory_order_acquire);
+			size_t e = clamp(b->enq.load(std::memory_order_acquire));
+			if (d >= e)
+			{
+				Block *nx = b->next.load(std::memory_order_acquire);
+				if (d < BlockSize || nx == NULL)
+					break;
+				Block *t = b;
+				tail.compare_exchange_strong(t, nx, std::memory_order_acq_rel, std::memory_order_relaxed); //the tail must not be left on a retired block
+				if (head.compare_exchange_strong(b, nx, std::memory_order_acq_rel, std::memory_order_relaxed))
+					retire(b);
+				continue;
+			}
+			size_t k = std::min(n - got, e - d);
+			if (!b->deq.compare_exchange_weak(d, d + k, std::memory_order_acq_rel, std::memory_order_relaxed))
+				continue;
+			for (size_t i = d; i < d + k; ++i)
+				if (take(b, i, dst[got]))
+					++got;
+		}
+		return got;
+	}
+
+	bool empty() //a snapshot, only exact when no other thread is active
+	{
+		Guard guard(*this);
+		Block *b = head.load(std::memory_order_acquire);
+		size_t d = b->deq.load(std::memory_order_acquire);
+		return d >= clamp(b->enq.load(std::memory_order_acquire)) && (d < BlockSize || b->next.load(std::memory_order_acquire) == NULL);
+	}
+};
+
+} // namespace sjtu
+
+#endif
@@ -2,136 +2,183 @@
 #define SJTU_DEQUE_HPP
 
 #include "exceptions.hpp"
+#include "simd.hpp"
+#include "slab_arena.hpp"
+#include <atomic>
 #include <cstring>
 #include <cstddef>
+#include <cstdint>
 #include <cmath>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
 namespace sjtu
 {
-const size_t MAX_BLOCK_SIZE = 2000;
+const size_t DEQUE_BLOCK_BYTES = 4096; //blocks are sized to about one page by default
+const size_t CACHE_LINE_BYTES = 64;
 
 template <class T>
+struct deque_block_size
+{
+	static const size_t value = sizeof(T) * 16 > DEQUE_BLOCK_BYTES ? 16 : DEQUE_BLOCK_BYTES / sizeof(T);
+};
+
+const size_t DEQUE_SMALL_BYTES = 64; //elements of a small deque are kept inside the deque object
+
+template <class T>
+struct deque_small_size
+{
+	static const size_t value = DEQUE_SMALL_BYTES / sizeof(T);
+};
+
+const size_t DEQUE_POOL_BLOCKS = 4; //default number of retired blocks a deque keeps for reuse
+
+template <class T, size_t BlockSize = deque_block_size<T>::value>
 class deque
 {
+	static_assert(BlockSize >= 2, "a deque block must be able to hold two elements");
+	static const size_t SmallSize = deque_small_size<T>::value < BlockSize ? deque_small_size<T>::value : BlockSize;
+	static const bool Trivial = std::is_trivially_copyable<T>::value; //elements may be moved and copied as raw bytes
+	static const size_t Linked = ~(~size_t(0) >> 1); //the top bit of Node::refs, see release
+	static const size_t BlockAlign = alignof(T) > CACHE_LINE_BYTES ? alignof(T) : CACHE_LINE_BYTES;
+
   public:
 	class const_iterator;
-	struct Node
+	struct Node //each block is a ring buffer, logical element i lives at data[(first + i) % capacity]
 	{
-		T *data[MAX_BLOCK_SIZE];
-		int blockSize;
+		T *data; //NULL for the sentinels
+		size_t capacity;
+		size_t first;
+		size_t blockSize;
+		size_t rank; //slot of the block in the counted index
+		size_t counted; //blockSize as the index last counted it
 		Node *prev;
 		Node *next;
-		Node() : blockSize(0), prev(NULL), next(NULL)
+		Node *store; //the block whose storage data points into
+		std::atomic<size_t> refs; //number of nodes using this block's own storage, plus Linked while its own header is in the list
+		bool bare; //a header without storage of its own, see shareFrom
+		bool slab; //a block allocated from slab_arena rather than new
+		bool leaked; //a mutable reference into this block's storage was handed out, see leak
+		Node() : data(NULL), capacity(0), first(0), blockSize(0), rank(0), counted(0), prev(NULL), next(NULL), store(this), refs(0), bare(false), slab(false), leaked(false) {}
+		Node(T *d, size_t cap) : data(d), capacity(cap), first(0), blockSize(0), rank(0), counted(0), prev(NULL), next(NULL), store(this), refs(0), bare(false), slab(false), leaked(false) {}
+		void destroy() //destroy the live elements, the storage itself stays
 		{
-			memset(data, 0, sizeof(data));
+			for (size_t i = 0; i < blockSize; ++i)
+				slot(i)->~T();
+			first = 0;
+			blockSize = 0;
 		}
-		Node(Node *p, Node *n) : blockSize(0), prev(p), next(n)
+		void dropFront(size_t k) //destroy the first k elements, nothing is shifted
 		{
-			memset(data, 0, sizeof(data));
+			for (size_t i = 0; i < k; ++i)
+				slot(i)->~T();
+			first = (first + k) % capacity;
+			blockSize -= k;
 		}
-		~Node()
+		void dropBack(size_t k) //destroy the last k elements
 		{
-			for (int i = 0; i < MAX_BLOCK_SIZE; ++i)
-			{
-				if (data[i])
-					delete data[i];
-				data[i] = NULL;
-			}
-			blockSize = 0;
-			prev = NULL;
-			next = NULL;
+			for (size_t i = blockSize - k; i < blockSize; ++i)
+				slot(i)->~T();
+			blockSize -= k;
+		}
+		T *slot(size_t i)
+		{
+			i += first;
+			if (i >= capacity)
+				i -= capacity;
+			return data + i;
 		}
+		const T *slot(size_t i) const
+		{
+			i += first;
+			if (i >= capacity)
+				i -= capacity;
+			return data + i;
+		}
+	};
+	struct Block : Node //a heap-allocated block, the storage follows the header from the next cache line on
+	{
+		alignas(BlockAlign) unsigned char storage[sizeof(T) * BlockSize];
+		Block() : Node(reinterpret_cast<T *>(storage), BlockSize) {}
 	};
 	class iterator
 	{
 	  public:
-		int index;
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef ptrdiff_t difference_type;
+		typedef T * pointer;
+		typedef T & reference;
+
+		size_t index;
 		Node *node;
-		deque<T> *container;
+		deque *container;
 		iterator() : index(0), node(NULL), container(NULL) {}
-		iterator(int x, Node *n, deque<T> *id) : index(x), node(n), container(id) {}
+		iterator(size_t x, Node *n, deque *id) : index(x), node(n), container(id) {}
 		iterator(const iterator &rhs) : index(rhs.index), node(rhs.node), container(rhs.container) {}
 
 	  public:
-		iterator operator+(const int &n) const
+		iterator operator+(const ptrdiff_t &n) const
 		{
 			iterator tmp = *this;
 			return tmp += n;
 		}
-		iterator operator-(const int &n) const
+		iterator operator-(const ptrdiff_t &n) const
 		{
 			iterator tmp = *this;
 			return tmp -= n;
 		}
-		int operator-(const iterator &rhs) const
+		ptrdiff_t operator-(const iterator &rhs) const
 		{
 			if (container == rhs.container)
-			{
-				Node *p_this = container->getHead()->next, *p_rhs = rhs.container->getHead()->next;
-				ptrdiff_t offset_this = 0;
-				ptrdiff_t offset_rhs = 0;
-				while (p_this != node)
-				{
-					offset_this += p_this->blockSize;
-					p_this = p_this->next;
-				}
-				offset_this += index;
-				while (p_rhs != rhs.node)
-				{
-					offset_rhs += p_rhs->blockSize;
-					p_rhs = p_rhs->next;
-				}
-				offset_rhs += rhs.index;
-				ptrdiff_t offset = offset_this - offset_rhs;
-				return offset;
-			}
+				return ptrdiff_t(container->position(node, index)) - ptrdiff_t(container->position(rhs.node, rhs.index));
 			else
 				throw invalid_iterator();
 		}
-		iterator operator+=(const int &n)
+		iterator &operator+=(const ptrdiff_t &n)
 		{
-			if (n < 0)
-				return operator-=(-n);
 			if (n == 0)
 				return *this;
-			size_t offset = n;
-			if (offset + index < node->blockSize)
-				index += offset;
-			else
+			if (node != container->getTail() && ptrdiff_t(index) + n >= 0 && ptrdiff_t(index) + n < ptrdiff_t(node->blockSize)) //stays in this block
 			{
-				int a = node->blockSize;
-				int b = index;
-				offset -= (node->blockSize - index);
-				node = node->next;
-				while (node->blockSize <= offset && node != container->getTail())
-				{
-					offset -= node->blockSize;
-					node = node->next;
-				}
-				index = offset;
+				index += n;
+				return *this;
 			}
+			ptrdiff_t pos = ptrdiff_t(container->position(node, index)) + n;
+			if (pos < 0 || pos > ptrdiff_t(container->size()))
+				throw invalid_iterator();
+			node = container->findNode(pos, index);
 			return *this;
 		}
-		iterator operator-=(const int &n)
+		iterator &operator-=(const ptrdiff_t &n)
 		{
-			if (n < 0)
-				return operator+=(-n);
-			if (n == 0)
-				return *this;
-			ptrdiff_t offset = n;
-			if (offset <= index)
-				index -= offset;
-			else
-			{
-				offset -= (index + 1);
-				node = node->prev;
-				while (node->blockSize <= offset && node != container->getHead())
-				{
-					offset -= node->blockSize;
-					node = node->prev;
-				}
-				index = node->blockSize - offset - 1;
-			}
-			return *this;
+			return operator+=(-n);
+		}
+		friend iterator operator+(const ptrdiff_t &n, const iterator &it)
+		{
+			return it + n;
+		}
+		T & operator[](const ptrdiff_t &n) const
+		{
+			return *(*this + n);
+		}
+		bool operator<(const iterator &rhs) const
+		{
+			return *this - rhs < 0;
+		}
+		bool operator>(const iterator &rhs) const
+		{
+			return rhs < *this;
+		}
+		bool operator<=(const iterator &rhs) const
+		{
+			return !(rhs < *this);
+		}
+		bool operator>=(const iterator &rhs) const
+		{
+			return !(*this < rhs);
 		}
 
 		iterator operator++(int)
@@ -143,19 +190,14 @@ class deque
 
 		iterator &operator++()
 		{
-			if (*this != container->end())
+			if (node == container->getTail())
+				throw invalid_iterator();
+			if (++index == node->blockSize) //the sentinel is the only block without elements
 			{
-				if (index + 1 <= node->blockSize - 1)
-					++index;
-				else
-				{
-					node = node->next;
-					index = 0;
-				}
-				return *this;
+				node = node->next;
+				index = 0;
 			}
-			else
-				throw invalid_iterator();
+			return *this;
 		}
 
 		iterator operator--(int)
@@ -167,35 +209,25 @@ class deque
 
 		iterator &operator--()
 		{
-			if (*this != container->begin())
+			if (index > 0)
+				--index;
+			else if (node->prev != container->getHead())
 			{
-				if (node == container->getTail())
-				{
-					node = node->prev;
-					index = node->blockSize - 1;
-				}
-				else
-				{
-					if (index > 0)
-					{
-						--index;
-					}
-					else
-					{
-						node = node->prev;
-						index = node->blockSize - 1;
-					}
-				}
-				return *this;
+				node = node->prev;
+				index = node->blockSize - 1;
 			}
 			else
 				throw invalid_iterator();
+			return *this;
 		}
 
 		T &operator*() const
 		{
-			if (*this != container->end())
-				return *(node->data[index]);
+			if (node != container->getTail())
+			{
+				container->leak(node);
+				return *(node->slot(index));
+			}
 			else
 				throw invalid_iterator();
 		}
@@ -234,118 +266,99 @@ class deque
 	class const_iterator
 	{
 	  public:
-		int index;
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const T * pointer;
+		typedef const T & reference;
+
+		size_t index;
 		const Node *node;
-		const deque<T> *container;
+		const deque *container;
 		const_iterator() : index(0), node(NULL), container(NULL) {}
-		const_iterator(int x, const Node *n, const deque<T> *id) : index(x), node(n), container(id) {}
+		const_iterator(size_t x, const Node *n, const deque *id) : index(x), node(n), container(id) {}
 		const_iterator(const iterator &other) : index(other.index), node(other.node), container(other.container) {}
 		const_iterator(const const_iterator &other) : index(other.index), node(other.node), container(other.container) {}
 
 	  public:
-		const_iterator operator+(const int &n) const
+		const_iterator operator+(const ptrdiff_t &n) const
 		{
 			const_iterator tmp = *this;
 			return tmp += n;
 		}
-		const_iterator operator-(const int &n) const
+		const_iterator operator-(const ptrdiff_t &n) const
 		{
 			const_iterator tmp = *this;
 			return tmp -= n;
 		}
-
-		int operator-(const const_iterator &rhs) const
+		ptrdiff_t operator-(const const_iterator &rhs) const
 		{
 			if (container == rhs.container)
-			{
-				Node *p_this = container->getHead()->next, *p_rhs = rhs.container->getHead()->next;
-				ptrdiff_t offset_this = 0;
-				ptrdiff_t offset_rhs = 0;
-				while (p_this != node)
-				{
-					offset_this += p_this->blockSize;
-					p_this = p_this->next;
-				}
-				offset_this += index;
-				while (p_rhs != rhs.node)
-				{
-					offset_rhs += p_rhs->blockSize;
-					p_rhs = p_rhs->next;
-				}
-				offset_rhs += rhs.index;
-				ptrdiff_t offset = offset_this - offset_rhs;
-				return offset;
-			}
+				return ptrdiff_t(container->position(node, index)) - ptrdiff_t(container->position(rhs.node, rhs.index));
 			else
 				throw invalid_iterator();
 		}
-		const_iterator operator+=(const int &n)
+		const_iterator &operator+=(const ptrdiff_t &n)
 		{
-			if (n < 0)
-				return operator-=(-n);
 			if (n == 0)
 				return *this;
-			ptrdiff_t offset = n;
-			if (offset + index < node->blockSize)
-				index += offset;
-			else
+			if (node != container->getTail() && ptrdiff_t(index) + n >= 0 && ptrdiff_t(index) + n < ptrdiff_t(node->blockSize)) //stays in this block
 			{
-				offset -= (node->blockSize - index);
-				node = node->next;
-				while (node->blockSize <= offset && node != container->getTail())
-				{
-					offset -= node->blockSize;
-					node = node->next;
-				}
-				index = offset;
+				index += n;
+				return *this;
 			}
+			ptrdiff_t pos = ptrdiff_t(container->position(node, index)) + n;
+			if (pos < 0 || pos > ptrdiff_t(container->size()))
+				throw invalid_iterator();
+			node = container->findNode(pos, index);
 			return *this;
 		}
-		const_iterator operator-=(const int &n)
+		const_iterator &operator-=(const ptrdiff_t &n)
 		{
-			if (n < 0)
-				return operator+=(-n);
-			if (n == 0)
-				return *this;
-			ptrdiff_t offset = n;
-			if (offset <= index)
-				index -= offset;
-			else
-			{
-				offset -= (index + 1);
-				node = node->prev;
-				while (node->blockSize <= offset && node != container->getHead())
-				{
-					offset -= node->blockSize;
-					node = node->prev;
-				}
-				index = node->blockSize - offset - 1;
-			}
-			return *this;
+			return operator+=(-n);
+		}
+		friend const_iterator operator+(const ptrdiff_t &n, const const_iterator &it)
+		{
+			return it + n;
+		}
+		const T & operator[](const ptrdiff_t &n) const
+		{
+			return *(*this + n);
+		}
+		bool operator<(const const_iterator &rhs) const
+		{
+			return *this - rhs < 0;
+		}
+		bool operator>(const const_iterator &rhs) const
+		{
+			return rhs < *this;
+		}
+		bool operator<=(const const_iterator &rhs) const
+		{
+			return !(rhs < *this);
+		}
+		bool operator>=(const const_iterator &rhs) const
+		{
+			return !(*this < rhs);
 		}
 
 		const_iterator operator++(int)
 		{
-			iterator tmp = *this;
+			const_iterator tmp = *this;
 			++*this;
 			return tmp;
 		}
 
 		const_iterator &operator++()
 		{
-			if (*this != container->cend())
+			if (node == container->getTail())
+				throw invalid_iterator();
+			if (++index == node->blockSize) //the sentinel is the only block without elements
 			{
-				if (index + 1 <= node->blockSize - 1)
-					++index;
-				else
-				{
-					node = node->next;
-					index = 0;
-				}
-				return *this;
+				node = node->next;
+				index = 0;
 			}
-			else
-				throw invalid_iterator();
+			return *this;
 		}
 
 		const_iterator operator--(int)
@@ -357,40 +370,27 @@ class deque
 
 		const_iterator &operator--()
 		{
-			if (*this != container->cbegin())
+			if (index > 0)
+				--index;
+			else if (node->prev != container->getHead())
 			{
-				if (node == container->getTail())
-				{
-					node = node->prev;
-					index = node->blockSize - 1;
-				}
-				else
-				{
-					if (index > 0)
-					{
-						--index;
-					}
-					else
-					{
-						node = node->prev;
-						index = node->blockSize - 1;
-					}
-				}
-				return *this;
+				node = node->prev;
+				index = node->blockSize - 1;
 			}
 			else
 				throw invalid_iterator();
+			return *this;
 		}
 
-		T &operator*() const
+		const T &operator*() const
 		{
-			if (*this != container->cend())
-				return *(node->data[index]);
+			if (node != container->getTail())
+				return *(node->slot(index));
 			else
 				throw invalid_iterator();
 		}
 
-		T *operator->() const noexcept
+		const T *operator->() const noexcept
 		{
 			return &(operator*());
 		}
@@ -424,387 +424,2249 @@ class deque
 
 	/*....................................................................................*/
   private:
-	Node *head;
-	Node *tail;
-	int curLength;
-	void addNode(Node *n, size_t pos, const T &value)
+	Node head; //sentinels live inside the deque, so an empty deque owns no heap memory
+	Node tail;
+	Node small; //inline first block, used while the deque fits in it
+	alignas(T) unsigned char smallStorage[SmallSize ? sizeof(T) * SmallSize : 1];
+	size_t curLength;
+	Node *pool; //retired heap blocks, linked through next
+	size_t poolSize;
+	size_t poolLimit;
+
+	/*
+	 * Counted block index: the blocks occupy slots of blocks[] in list order, with free
+	 * slots between them, and sizeTree is a Fenwick tree over the slots counting the
+	 * elements of each block, so positional lookup costs O(log blocks). Every operation
+	 * that changes the deque brings the index up to date before it returns, lookups
+	 * only read it. A new block takes a free slot between its neighbours, moving a few
+	 * blocks aside if there is none; only when no free slot is near are the blocks laid
+	 * out again, with a free slot after each and room at both ends. The first and the
+	 * last block are left out of the updates, so pushing and popping at the ends does
+	 * not touch the tree: lookups find them directly and correct for the first one.
+	 * at() and operator[] of a non-const deque remember the block they found as a
+	 * cursor, so a lookup in the same or a neighbouring block, as in a d[i] loop,
+	 * needs no descent. The const ones neither read nor write the cursor, so threads
+	 * sharing a const deque do not race, and each of them descends the tree; read a
+	 * const deque in order through iterators, which step within a block without any
+	 * lookup. Positions in the index and the cursor's are as the tree counts them.
+	 */
+	Node **blocks; //NULL for a free slot
+	size_t *sizeTree;
+	size_t indexCapacity; //number of slots, a power of two
+	Node *cursor; //NULL or the block of the last non-const lookup
+	size_t cursorStart; //position of the cursor's first element as the tree counts
+	static const size_t IndexReach = 16; //a new block moves at most this many others aside
+
+	/*
+	 * Copy-on-write: when enabled, copies of the deque share its heap blocks instead of
+	 * copying the elements. Every node records the block owning the storage it reads
+	 * and each block counts the nodes using its storage. A node detaches, i.e. takes a
+	 * private copy of its block, right before anything writes through it, and a block
+	 * is freed once it is neither linked nor used as storage. A block that a mutable
+	 * reference, pointer or iterator dereference has been taken into is leaked: the
+	 * reference could still write through it, so later copies copy its elements
+	 * instead of sharing it. The counts are atomic, so a copy may be read, written and
+	 * destroyed on another thread than the deque it shares blocks with; making the
+	 * copy reads the source, and each deque is still used by one thread at a time.
+	 */
+	bool copyOnWrite;
+
+	/*
+	 * Huge-page mode: new blocks come from the slab_arena for this block size instead
+	 * of operator new. Every block remembers where it came from, so blocks that move to
+	 * another deque are still freed correctly. Blocks are aligned to BlockAlign either
+	 * way; operator new only promises less before C++17, so outside the arena a block
+	 * is placed in a larger allocation, with the allocation's address right before it.
+	 */
+	bool hugePages;
+	typedef slab_arena<sizeof(Block), BlockAlign> arena;
+
+	Node *allocBlock()
 	{
-		if (!empty())
+		void *p;
+		if (hugePages)
+			p = arena::instance().allocate();
+		else
+		{
+			char *raw = static_cast<char *>(::operator new(sizeof(Block) + BlockAlign));
+			char *aligned = raw + BlockAlign - reinterpret_cast<uintptr_t>(raw) % BlockAlign; //at least alignof(max_align_t) past raw, room for the pointer
+			reinterpret_cast<char **>(aligned)[-1] = raw;
+			p = aligned;
+		}
+		Node *n = new (p) Block;
+		n->slab = hugePages;
+		return n;
+	}
+	void freeBlock(Node *n)
+	{
+		bool slab = n->slab;
+		static_cast<Block *>(n)->~Block();
+		if (slab)
+			arena::instance().deallocate(n);
+		else
+			::operator delete(reinterpret_cast<char **>(n)[-1]);
+	}
+
+	void addCount(size_t slot, ptrdiff_t delta)
+	{
+		for (size_t i = slot + 1; i <= indexCapacity; i += i & -i)
+			sizeTree[i] += delta;
+	}
+	void rebuildIndex() //lay the blocks out again, every block followed by a free slot
+	{
+		size_t cnt = 0;
+		for (const Node *p = head.next; p != &tail; p = p->next)
+			++cnt;
+		size_t cap = 16;
+		while (cap < cnt * 4)
+			cap *= 2;
+		if (cap != indexCapacity)
 		{
-			if (n->blockSize < MAX_BLOCK_SIZE)
+			Node **b = new Node *[cap];
+			size_t *t;
+			try
 			{
-				for (size_t i = n->blockSize - 1; i >= pos; --i)
-				{
-					if (i >= n->blockSize) //in case that unsigned long long overflow
-						break;
-					n->data[i + 1] = n->data[i];
-				}
-				n->data[pos] = new T(value);
-				++n->blockSize;
+				t = new size_t[cap + 1];
 			}
-			else
+			catch (...)
 			{
-				if (n->blockSize == MAX_BLOCK_SIZE)
-				{
-					Node *cur_p = new Node(n, n->next);
-					n->next->prev = cur_p;
-					n->next = cur_p;
-					cur_p->blockSize = n->blockSize / 2;
-					for (size_t i = 0; i < cur_p->blockSize; ++i) //Copy MAX_BLOCK_SIZE / 2 elements into the new block
-					{
-						cur_p->data[i] = n->data[cur_p->blockSize + i];
-						n->data[cur_p->blockSize + i] = NULL;
-					}
-					n->blockSize /= 2;
-
-					if (pos + 1 <= cur_p->blockSize) //Insert the element in the previous node
-					{
-						for (size_t i = cur_p->blockSize - 1; i >= pos; --i)
-						{
-							if (i >= cur_p->blockSize)
-								break;
-							n->data[i + 1] = n->data[i];
-						}
-						n->data[pos] = new T(value);
-						++n->blockSize;
-					}
-					else //Insert the element in the new node
-					{
-						n = cur_p;
-						for (size_t i = cur_p->blockSize - 1; i >= pos - cur_p->blockSize; --i)
-						{
-							if (i >= cur_p->blockSize)
-								break;
-							n->data[i + 1] = n->data[i];
-						}
-						n->data[pos - cur_p->blockSize] = new T(value);
-						++n->blockSize;
-					}
-				}
+				delete[] b;
+				throw;
 			}
+			delete[] blocks;
+			delete[] sizeTree;
+			blocks = b;
+			sizeTree = t;
+			indexCapacity = cap;
 		}
-		else //the state that the container is empty
+		for (size_t i = 0; i < cap; ++i)
 		{
-			Node *cur_p = new Node(head, tail);
-			head->next = cur_p;
-			tail->prev = cur_p;
-			n = cur_p;
-			n->data[0] = new T(value);
-			++n->blockSize;
+			blocks[i] = NULL;
+			sizeTree[i + 1] = 0;
 		}
-		++curLength;
-	}
-	void removeNode(Node *n, int pos)
-	{
-		delete n->data[pos];
-		for (int i = pos; i < n->blockSize - 1; ++i)
+		size_t s = (cap - cnt * 2) / 2; //as much room before the blocks as after them
+		for (Node *p = head.next; p != &tail; p = p->next, s += 2)
 		{
-			n->data[i] = n->data[i + 1];
+			p->rank = s;
+			p->counted = p->blockSize;
+			blocks[s] = p;
+			sizeTree[s + 1] = p->blockSize;
 		}
-		n->data[n->blockSize - 1] = NULL;
-		--n->blockSize;
-		if (n->blockSize == 0)
+		for (size_t i = 1; i <= cap; ++i) //O(slots) Fenwick construction
 		{
-			n->prev->next = n->next;
-			n->next->prev = n->prev;
-			delete n;
-			n = NULL;
+			size_t j = i + (i & -i);
+			if (j <= cap)
+				sizeTree[j] += sizeTree[i];
 		}
-		--curLength;
+		cursor = NULL;
 	}
-
-  public:
-	deque()
-	{
-		head = new Node();
-		tail = new Node();
-		head->next = tail;
-		tail->prev = head;
-		head->prev = NULL;
-		tail->next = NULL;
-		curLength = 0;
+	void moveSlot(size_t from, size_t to) //slot to is free
+	{
+		Node *b = blocks[from];
+		addCount(from, -ptrdiff_t(b->counted));
+		addCount(to, ptrdiff_t(b->counted));
+		blocks[to] = b;
+		blocks[from] = NULL;
+		b->rank = to;
 	}
-	deque(const deque &other)
+	bool makeRoom(size_t &lo, size_t &hi) //lo == hi: free a slot there by moving at most IndexReach blocks aside
 	{
-		head = new Node();
-		tail = new Node();
-		head->next = tail;
-		tail->prev = head;
-		head->prev = NULL;
-		tail->next = NULL;
-		curLength = other.curLength;
-
-		Node *p = other.head->next;
-		Node *q = head;
-		Node *r;
-		while (p != other.tail)
+		for (size_t d = 0; d < IndexReach; ++d)
 		{
-			r = new Node(q, q->next);
-			q->next->prev = r;
-			q->next = r;
-			r->blockSize = p->blockSize;
-			for (int i = 0; i < p->blockSize; ++i)
+			if (lo + d < indexCapacity && blocks[lo + d] == NULL)
+			{
+				for (size_t i = lo + d; i > lo; --i)
+					moveSlot(i - 1, i);
+				hi = lo + 1;
+				return true;
+			}
+			if (d < lo && blocks[lo - 1 - d] == NULL)
 			{
-				r->data[i] = new T(*(p->data[i]));
+				for (size_t i = lo - 1 - d; i + 1 < lo; ++i)
+					moveSlot(i + 1, i);
+				hi = lo--;
+				return true;
 			}
-			p = p->next;
-			q = q->next;
 		}
+		return false;
 	}
-
-	~deque()
-	{
-		clear();
-		delete head;
-		delete tail;
-	}
-
-	deque &operator=(const deque &other)
+	size_t freeSlot(const Node *p, const Node *n) //a free slot between the neighbouring blocks p and n
 	{
-		if (this == &other)
-			return *this;
-		clear();
-		curLength = other.curLength;
-
-		Node *p = other.head->next;
-		Node *q = head;
-		Node *r;
-		while (p != other.tail)
+		size_t lo = p == &head ? 0 : p->rank + 1, hi = n == &tail ? indexCapacity : n->rank;
+		if (lo == hi && !makeRoom(lo, hi))
 		{
-			r = new Node(q, q->next);
-			q->next->prev = r;
-			q->next = r;
-			r->blockSize = p->blockSize;
-			for (int i = 0; i < p->blockSize; ++i)
-			{
-				r->data[i] = new T(*(p->data[i]));
-			}
-			p = p->next;
-			q = q->next;
+			rebuildIndex();
+			lo = p == &head ? 0 : p->rank + 1;
+			hi = n == &tail ? indexCapacity : n->rank;
 		}
-		return *this;
+		if (p == &head && n != &tail) //keep the room at either end for more blocks pushed there
+			return hi - 1;
+		if (n == &tail && p != &head)
+			return lo;
+		return lo + (hi - lo) / 2;
 	}
-
-	T &at(const size_t &pos)
+	void recount(Node *n) //bring the index up to date with n->blockSize
+	{
+		if (n == head.next || n == tail.prev) //the end blocks are recounted once they get a neighbour
+			return;
+		ptrdiff_t delta = ptrdiff_t(n->blockSize) - ptrdiff_t(n->counted);
+		if (delta == 0)
+			return;
+		if (cursor && n->rank < cursor->rank)
+			cursorStart += delta;
+		addCount(n->rank, delta);
+		n->counted = n->blockSize;
+	}
+	void recount(Node *from, Node *to) //the blocks from from to to, both included
+	{
+		for (Node *p = from; p != to; p = p->next)
+			recount(p);
+		recount(to);
+	}
+	void unindex(Node *n) //give up the slot of a block that is being unlinked
+	{
+		if (cursor == n)
+			cursor = NULL;
+		else if (cursor && n->rank < cursor->rank)
+			cursorStart -= n->counted;
+		addCount(n->rank, -ptrdiff_t(n->counted));
+		blocks[n->rank] = NULL;
+		n->counted = 0;
+	}
+	size_t position(const Node *n, size_t index) const //number of elements before (n, index)
+	{
+		if (n == &tail)
+			return curLength;
+		if (n == head.next)
+			return index;
+		size_t res = index + head.next->blockSize - head.next->counted;
+		for (size_t i = n->rank; i > 0; i -= i & -i)
+			res += sizeTree[i];
+		return res;
+	}
+	Node *findNode(size_t pos, size_t &offset) const //block holding the pos-th element, tail if pos == size()
 	{
-		if (pos < size() && pos >= 0)
+		if (pos >= curLength)
 		{
-			size_t offset = pos;
-			Node *cur_p = head->next;
-			while (offset > cur_p->blockSize - 1)
-			{
-				offset -= cur_p->blockSize;
-				cur_p = cur_p->next;
-			}
-			return *(cur_p->data[offset]);
+			offset = 0;
+			return getTail();
 		}
-		else
-			throw index_out_of_bound();
+		if (pos < head.next->blockSize) //small deques never need the index
+		{
+			offset = pos;
+			return head.next;
+		}
+		if (curLength - pos <= tail.prev->blockSize)
+		{
+			offset = pos - (curLength - tail.prev->blockSize);
+			return tail.prev;
+		}
+		return descend(pos - head.next->blockSize + head.next->counted, offset);
 	}
-	const T &at(const size_t &pos) const
+	Node *descend(size_t pos, size_t &offset) const //Fenwick descent for the last slot starting at or before pos as the tree counts, free slots count nothing
 	{
-		if (pos < size() && pos >= 0)
+		size_t r = 0;
+		for (size_t step = indexCapacity; step; step /= 2)
 		{
-			size_t offset = pos;
-			const Node *cur_p = head->next;
-			while (offset > cur_p->blockSize - 1)
+			if (r + step <= indexCapacity && sizeTree[r + step] <= pos)
 			{
-				offset -= cur_p->blockSize;
-				cur_p = cur_p->next;
+				r += step;
+				pos -= sizeTree[r];
 			}
-			return *(cur_p->data[offset]);
 		}
-		else
-			throw index_out_of_bound();
+		offset = pos;
+		return blocks[r];
 	}
-	T &operator[](const size_t &pos)
+	Node *seek(size_t pos, size_t &offset) //findNode for pos < size() that tries the cursor's block and its neighbours first
 	{
-		if (pos < size() && pos >= 0)
+		if (pos < head.next->blockSize || curLength - pos <= tail.prev->blockSize)
+			return findNode(pos, offset);
+		pos = pos - head.next->blockSize + head.next->counted;
+		if (cursor && cursor != head.next && cursor != tail.prev)
 		{
-			size_t offset = pos;
-			Node *cur_p = head->next;
-			while (offset > cur_p->blockSize - 1)
+			if (pos >= cursorStart && pos - cursorStart < cursor->blockSize)
+			{
+				offset = pos - cursorStart;
+				return cursor;
+			}
+			if (pos >= cursorStart && cursor->next != &tail && pos - cursorStart - cursor->blockSize < cursor->next->blockSize)
 			{
-				offset -= cur_p->blockSize;
-				cur_p = cur_p->next;
+				cursorStart += cursor->blockSize;
+				cursor = cursor->next;
+				offset = pos - cursorStart;
+				return cursor;
+			}
+			if (pos < cursorStart && cursor->prev != &head && cursorStart - pos <= cursor->prev->blockSize)
+			{
+				cursor = cursor->prev;
+				cursorStart -= cursor->blockSize;
+				offset = pos - cursorStart;
+				return cursor;
 			}
-			return *(cur_p->data[offset]);
 		}
-		else
-			throw index_out_of_bound();
+		cursor = descend(pos, offset);
+		cursorStart = pos - offset;
+		return cursor;
 	}
-	const T &operator[](const size_t &pos) const
+
+	Node *newNode(Node *p, Node *n) //link an empty block between p and n
 	{
-		if (pos < size() && pos >= 0)
+		size_t s = freeSlot(p, n);
+		Node *cur_p;
+		if (SmallSize && small.next == NULL && curLength == 0)
+			cur_p = &small;
+		else if (pool)
 		{
-			size_t offset = pos;
-			const Node *cur_p = head->next;
-			while (offset > cur_p->blockSize - 1)
-			{
-				offset -= cur_p->blockSize;
-				cur_p = cur_p->next;
-			}
-			return *(cur_p->data[offset]);
+			cur_p = pool;
+			pool = pool->next;
+			--poolSize;
 		}
 		else
-			throw index_out_of_bound();
+			cur_p = allocBlock();
+		cur_p->store = cur_p;
+		cur_p->refs.store(cur_p == &small ? 1 : Linked | 1, std::memory_order_relaxed);
+		cur_p->prev = p;
+		cur_p->next = n;
+		p->next = cur_p;
+		n->prev = cur_p;
+		cur_p->rank = s;
+		cur_p->counted = 0;
+		blocks[s] = cur_p;
+		if (p != &head)
+			recount(p);
+		if (n != &tail)
+			recount(n);
+		return cur_p;
 	}
-
-	const T &front() const
+	void deleteNode(Node *n) //unlink a block and free it
 	{
-		if (!empty())
-			return *(head->next->data[0]);
-		else
-			throw container_is_empty();
+		unindex(n);
+		n->prev->next = n->next;
+		n->next->prev = n->prev;
+		n->prev = NULL;
+		n->next = NULL;
+		release(n);
+		if (n->bare)
+			delete n;
+		else if (n != &small && n->refs.fetch_sub(Linked, std::memory_order_acq_rel) == Linked) //otherwise other nodes still read its storage
+			retire(n);
 	}
-
-	const T &back() const
+	/*
+	 * A snapshot may be destroyed on another thread while the deque it was copied from
+	 * goes on, so the users of a block and whether its own header is still linked are
+	 * kept in one atomic word: whoever brings the users to zero destroys the elements,
+	 * and whoever brings the whole word to zero, by the last release or by deleteNode,
+	 * retires the block.
+	 */
+	void release(Node *n) //drop the use of n's storage, the last user destroys the elements
 	{
-		if (!empty())
+		Node *s = n->store;
+		size_t left = s->refs.fetch_sub(1, std::memory_order_acq_rel) - 1;
+		if ((left & ~Linked) == 0)
 		{
-			return *(tail->prev->data[tail->prev->blockSize - 1]);
+			n->destroy();
+			if (left == 0 && s != n)
+				retire(s);
 		}
-		else
-			throw container_is_empty();
+		n->first = 0;
+		n->blockSize = 0;
 	}
-
-	iterator begin()
+	void retire(Node *n) //return an unused heap block to the pool
 	{
-		return iterator(0, head->next, this);
+		n->data = reinterpret_cast<T *>(static_cast<Block *>(n)->storage);
+		n->store = n;
+		n->leaked = false;
+		n->first = 0;
+		n->blockSize = 0;
+		if (poolSize < poolLimit)
+		{
+			n->next = pool;
+			pool = n;
+			++poolSize;
+		}
+		else
+			freeBlock(n);
 	}
-	const_iterator cbegin() const
+	void detach(Node *n) //give n a private copy of its storage before it is written through
 	{
-		return const_iterator(0, head->next, this);
+		if (copyOnWrite && (n->store->refs.load(std::memory_order_acquire) & ~Linked) != 1)
+			detach(n, std::is_copy_constructible<T>());
 	}
-
-	iterator end()
+	void leak(Node *n) //detach before a mutable reference into n is handed out, which also keeps later copies from sharing its storage
 	{
-		return iterator(0, tail, this);
+		detach(n);
+		n->store->leaked = true;
 	}
-	const_iterator cend() const
+	void detach(Node *, std::false_type) {} //move-only elements are never shared
+	void detach(Node *n, std::true_type)
 	{
-		return const_iterator(0, tail, this);
+		Node *s;
+		if (pool)
+		{
+			s = pool;
+			pool = pool->next;
+			s->next = NULL;
+			--poolSize;
+		}
+		else
+			s = allocBlock();
+		if (Trivial)
+			copySlots(s, 0, n, 0, n->blockSize);
+		else
+			for (size_t i = 0; i < n->blockSize; ++i)
+				new (s->data + i) T(*(n->slot(i)));
+		size_t k = n->blockSize;
+		release(n); //the other users may have let go meanwhile, then the originals go here
+		s->refs.store(1, std::memory_order_relaxed);
+		n->store = s;
+		n->data = s->data;
+		n->first = 0;
+		n->blockSize = k;
 	}
-
-	bool empty() const
+	void shareFrom(const deque &other) //link bare headers onto the blocks of other, its inline block and leaked blocks are copied
 	{
-		return curLength == 0;
+		copyOnWrite = true;
+		for (const Node *p = other.head.next; p != &other.tail; p = p->next)
+		{
+			if (p == &other.small || p->store->leaked)
+			{
+				Node *n = newNode(tail.prev, &tail);
+				for (size_t i = 0; i < p->blockSize; ++i)
+				{
+					if (n->blockSize == n->capacity) //only when the first copy landed in our inline block
+						n = newNode(n, &tail);
+					new (n->slot(n->blockSize)) T(*(p->slot(i)));
+					++n->blockSize;
+				}
+			}
+			else
+			{
+				size_t s = freeSlot(tail.prev, &tail);
+				Node *n = new Node(p->data, p->capacity);
+				n->bare = true;
+				n->first = p->first;
+				n->blockSize = p->blockSize;
+				n->store = p->store;
+				n->store->refs.fetch_add(1, std::memory_order_relaxed);
+				n->prev = tail.prev;
+				n->next = &tail;
+				tail.prev->next = n;
+				tail.prev = n;
+				n->rank = s;
+				blocks[s] = n;
+				recount(n->prev);
+			}
+			curLength += p->blockSize;
+		}
 	}
-
-	size_t size() const
+	void stealFrom(deque &other) //take over the blocks of other, *this must hold none
 	{
-		return curLength;
+		curLength = other.curLength;
+		if (other.head.next != &other.tail)
+		{
+			head.next = other.head.next;
+			tail.prev = other.tail.prev;
+			head.next->prev = &head;
+			tail.prev->next = &tail;
+		}
+		std::swap(blocks, other.blocks); //ours is empty, as other is about to be
+		std::swap(sizeTree, other.sizeTree);
+		std::swap(indexCapacity, other.indexCapacity);
+		cursor = other.cursor == &other.small ? &small : other.cursor; //the index came along, so its cursor is still right
+		cursorStart = other.cursorStart;
+		other.cursor = NULL;
+		if (other.small.next) //the inline block cannot be stolen, its elements move over instead
+		{
+			small.first = 0;
+			small.refs.store(1, std::memory_order_relaxed);
+			moveSlots(&small, 0, &other.small, 0, other.small.blockSize);
+			small.blockSize = other.small.blockSize;
+			small.prev = other.small.prev;
+			small.next = other.small.next;
+			small.prev->next = &small;
+			small.next->prev = &small;
+			small.rank = other.small.rank;
+			small.counted = other.small.counted;
+			blocks[small.rank] = &small;
+			other.small.first = 0;
+			other.small.blockSize = 0;
+			other.small.counted = 0;
+			other.small.refs.store(0, std::memory_order_relaxed);
+			other.small.prev = NULL;
+			other.small.next = NULL;
+		}
+		std::swap(pool, other.pool);
+		std::swap(poolSize, other.poolSize);
+		std::swap(poolLimit, other.poolLimit);
+		copyOnWrite = other.copyOnWrite;
+		hugePages = other.hugePages;
+		other.head.next = &other.tail;
+		other.tail.prev = &other.head;
+		other.curLength = 0;
 	}
+	class fill_iterator //yields the same value count times, feeds insert(pos, n, value) into insertRange
+	{
+		const T *value;
+		size_t count;
 
-	void clear()
+	  public:
+		fill_iterator(const T *v, size_t n) : value(v), count(n) {}
+		const T &operator*() const { return *value; }
+		fill_iterator &operator++()
+		{
+			--count;
+			return *this;
+		}
+		bool operator==(const fill_iterator &rhs) const { return count == rhs.count; }
+		bool operator!=(const fill_iterator &rhs) const { return count != rhs.count; }
+	};
+	/*
+	 * Insert [first, last) before the pos-th element of n. The tail of n is split off
+	 * at most once, the new elements are written into the free room of n and then
+	 * straight into fresh blocks, and the split-off tail is folded back into the last
+	 * block if it fits.
+	 */
+	template <class InputIt>
+	iterator insertRange(Node *n, size_t pos, InputIt first, InputIt last)
 	{
-		Node *p = head->next, *q;
-		head->next = tail;
-		tail->prev = head;
-		while (p != tail)
+		if (first == last)
+			return iterator(pos, n, this);
+		Node *cur, *stop, *rest = NULL;
+		if (n == &tail)
 		{
-			q = p->next;
-			delete p;
-			p = q;
+			cur = tail.prev;
+			stop = &tail;
 		}
-		curLength = 0;
+		else if (pos == 0)
+		{
+			cur = n->prev;
+			stop = n;
+		}
+		else
+		{
+			detach(n);
+			rest = newNode(n, n->next);
+			moveSlots(rest, 0, n, pos, n->blockSize - pos);
+			rest->blockSize = n->blockSize - pos;
+			n->blockSize = pos;
+			recount(n);
+			recount(rest);
+			cur = n;
+			stop = rest;
+		}
+		if (cur == &head || cur->blockSize == cur->capacity)
+			cur = newNode(cur, stop);
+		else
+			detach(cur);
+		Node *firstNode = cur;
+		size_t firstIndex = cur->blockSize;
+		try
+		{
+			writeRange(cur, stop, first, last, std::integral_constant<bool, Trivial && std::is_convertible<InputIt, const T *>::value>());
+		}
+		catch (...) //keep what was written, but no empty block may stay linked
+		{
+			recount(firstNode, cur);
+			if (cur->blockSize == 0)
+				deleteNode(cur);
+			throw;
+		}
+		recount(firstNode, cur);
+		if (rest && cur != rest && cur->blockSize + rest->blockSize <= cur->capacity)
+		{
+			moveToBack(rest, cur);
+			deleteNode(rest);
+		}
+		return iterator(firstIndex, firstNode, this);
 	}
-
-	iterator insert(iterator pos, const T &value)
+	template <class InputIt>
+	void writeRange(Node *&cur, Node *stop, InputIt first, InputIt last, std::false_type) //append [first, last) after cur, opening blocks before stop
 	{
-		if (pos.container != this || pos.node == NULL)
-			throw invalid_iterator();
-		if (pos.node == tail)
+		for (; first != last; ++first)
 		{
-			if (!empty())
+			if (cur->blockSize == cur->capacity)
+				cur = newNode(cur, stop);
+			new (cur->slot(cur->blockSize)) T(*first);
+			++cur->blockSize;
+			++curLength;
+		}
+	}
+	void writeRange(Node *&cur, Node *stop, const T *first, const T *last, std::true_type) //contiguous source: one memcpy per free run
+	{
+		while (first != last)
+		{
+			if (cur->blockSize == cur->capacity)
+				cur = newNode(cur, stop);
+			size_t k = cur->capacity - cur->blockSize;
+			if (k > size_t(last - first))
+				k = last - first;
+			k = run(cur, cur->blockSize, k);
+			std::memcpy(static_cast<void *>(cur->slot(cur->blockSize)), first, k * sizeof(T));
+			first += k;
+			cur->blockSize += k;
+			curLength += k;
+		}
+	}
+	void copyFrom(const deque &other)
+	{
+		if (other.copyOnWrite)
+			shareFrom(other);
+		else
+			copyFrom(other, std::integral_constant<bool, Trivial>());
+	}
+	void copyFrom(const deque &other, std::false_type)
+	{
+		for (const Node *p = other.head.next; p != &other.tail; p = p->next)
+			for (size_t i = 0; i < p->blockSize; ++i)
+				push_back(*(p->slot(i)));
+	}
+	void copyFrom(const deque &other, std::true_type) //fill whole blocks, copying each source block in at most a few memcpy calls
+	{
+		Node *cur = tail.prev;
+		for (const Node *p = other.head.next; p != &other.tail; p = p->next)
+			for (size_t done = 0; done < p->blockSize;)
 			{
-				addNode(tail->prev, tail->prev->blockSize, value);
-				return iterator(tail->prev->blockSize - 1, tail->prev, this);
+				if (cur == &head || cur->blockSize == cur->capacity)
+					cur = newNode(cur, &tail);
+				size_t k = cur->capacity - cur->blockSize;
+				if (k > p->blockSize - done)
+					k = p->blockSize - done;
+				copySlots(cur, cur->blockSize, p, done, k);
+				cur->blockSize += k;
+				curLength += k;
+				done += k;
+				recount(cur);
 			}
-			else
+	}
+	static void relocate(T *dst, T *src) //move an element to uninitialized storage and destroy the source
+	{
+		new (dst) T(std::move(*src));
+		src->~T();
+	}
+	static size_t run(const Node *n, size_t i, size_t k) //how many of the k slots from i on are contiguous in memory
+	{
+		size_t p = n->first + i;
+		if (p >= n->capacity)
+			p -= n->capacity;
+		return n->capacity - p < k ? n->capacity - p : k;
+	}
+	template <class N, class F>
+	static void visitRuns(N *n, size_t i, size_t j, F &f) //pass elements [i, j) of n to f as at most two runs
+	{
+		if (i == j)
+			return;
+		size_t c = run(n, i, j - i);
+		f(n->slot(i), n->slot(i) + c);
+		if (c < j - i)
+			f(n->slot(i + c), n->slot(i + c) + (j - i - c));
+	}
+	static size_t runBack(const Node *n, size_t e, size_t k) //the same for the k slots ending before e
+	{
+		size_t p = (n->first + e - 1) % n->capacity + 1;
+		return p < k ? p : k;
+	}
+	/*
+	 * Move k elements from slots si.. of src into the uninitialized slots di.. of dst.
+	 * src and dst may be the same block with overlapping ranges, the copy runs in the
+	 * direction that never overwrites a slot before it is read.
+	 */
+	static void moveSlots(Node *dst, size_t di, Node *src, size_t si, size_t k)
+	{
+		moveSlots(dst, di, src, si, k, std::integral_constant<bool, Trivial>());
+	}
+	static void moveSlots(Node *dst, size_t di, Node *src, size_t si, size_t k, std::false_type)
+	{
+		if (dst == src && di > si)
+			for (size_t i = k; i > 0; --i)
+				relocate(dst->slot(di + i - 1), src->slot(si + i - 1));
+		else
+			for (size_t i = 0; i < k; ++i)
+				relocate(dst->slot(di + i), src->slot(si + i));
+	}
+	static void moveSlots(Node *dst, size_t di, Node *src, size_t si, size_t k, std::true_type)
+	{
+		if (dst == src && di > si)
+			while (k)
 			{
-				addNode(tail, pos.index, value);
-				return iterator(tail->prev->blockSize - 1, tail->prev, this);
+				size_t c = runBack(src, si + k, runBack(dst, di + k, k));
+				std::memmove(static_cast<void *>(dst->slot(di + k - c)), src->slot(si + k - c), c * sizeof(T));
+				k -= c;
 			}
-		}
 		else
+			while (k)
+			{
+				size_t c = run(src, si, run(dst, di, k));
+				std::memmove(static_cast<void *>(dst->slot(di)), src->slot(si), c * sizeof(T));
+				di += c;
+				si += c;
+				k -= c;
+			}
+	}
+	static void copySlots(Node *dst, size_t di, const Node *src, size_t si, size_t k) //trivially copyable only
+	{
+		while (k)
+		{
+			size_t c = run(src, si, run(dst, di, k));
+			std::memcpy(static_cast<void *>(dst->slot(di)), src->slot(si), c * sizeof(T));
+			di += c;
+			si += c;
+			k -= c;
+		}
+	}
+	template <class... Args>
+	iterator addNode(Node *n, size_t pos, Args &&... args) //returns the position of the new element
+	{
+		if (!empty() && pos != 0 && pos != n->blockSize) //args may refer to elements the shift is about to move
+		{
+			T tmp(std::forward<Args>(args)...);
+			return placeNode(n, pos, std::move(tmp));
+		}
+		return placeNode(n, pos, std::forward<Args>(args)...);
+	}
+	template <class... Args>
+	iterator placeNode(Node *n, size_t pos, Args &&... args)
+	{
+		if (!empty())
 		{
-			if (pos.node->blockSize == MAX_BLOCK_SIZE)
+			if (n->blockSize == n->capacity)
 			{
-				if (pos.index < MAX_BLOCK_SIZE / 2)
+				if (pos == 0 || pos == n->blockSize) //Insert at either end of a full block: start a new block there
 				{
-					addNode(pos.node, pos.index, value);
-					return iterator(pos.index, pos.node, this);
+					n = pos == 0 ? newNode(n->prev, n) : newNode(n, n->next);
+					pos = 0;
 				}
 				else
 				{
-					addNode(pos.node, pos.index, value);
-					return iterator(pos.index - MAX_BLOCK_SIZE / 2, pos.node->next, this);
+					detach(n);
+					Node *cur_p = newNode(n, n->next);
+					cur_p->blockSize = n->blockSize / 2;
+					moveSlots(cur_p, 0, n, n->blockSize - cur_p->blockSize, cur_p->blockSize); //Move half of the elements into the new block
+					n->blockSize -= cur_p->blockSize;
+					recount(n);
+					recount(cur_p);
+
+					if (pos >= n->blockSize) //Insert the element in the new node
+					{
+						pos -= n->blockSize;
+						n = cur_p;
+					}
+				}
+			}
+			detach(n);
+			if (pos < n->blockSize - pos) //shift the elements before pos one slot towards the front
+			{
+				n->first = n->first ? n->first - 1 : n->capacity - 1;
+				moveSlots(n, 0, n, 1, pos);
+				try
+				{
+					new (n->slot(pos)) T(std::forward<Args>(args)...);
+				}
+				catch (...) //close the gap again, the block is left as it was
+				{
+					moveSlots(n, 1, n, 0, pos);
+					n->first = n->first + 1 == n->capacity ? 0 : n->first + 1;
+					throw;
 				}
 			}
 			else
 			{
-				addNode(pos.node, pos.index, value);
-				return iterator(pos.index, pos.node, this);
+				moveSlots(n, pos + 1, n, pos, n->blockSize - pos);
+				try
+				{
+					new (n->slot(pos)) T(std::forward<Args>(args)...);
+				}
+				catch (...)
+				{
+					moveSlots(n, pos, n, pos + 1, n->blockSize - pos);
+					if (n->blockSize == 0) //the block was opened for this element
+						deleteNode(n);
+					throw;
+				}
+			}
+			++n->blockSize;
+			recount(n);
+		}
+		else //the state that the container is empty
+		{
+			n = newNode(&head, &tail);
+			pos = 0;
+			try
+			{
+				new (n->slot(0)) T(std::forward<Args>(args)...);
 			}
+			catch (...)
+			{
+				deleteNode(n);
+				throw;
+			}
+			++n->blockSize;
+			recount(n);
 		}
+		++curLength;
+		return iterator(pos, n, this);
 	}
-	iterator erase(iterator pos)
+	void moveToBack(Node *from, Node *to) //append all elements of from to to
 	{
-		if (curLength == 0 || pos == end() || pos.container != this || pos.node == NULL)
-			throw invalid_iterator();
-		if (pos.index == pos.node->blockSize - 1)
+		detach(from);
+		detach(to);
+		moveSlots(to, to->blockSize, from, 0, from->blockSize);
+		to->blockSize += from->blockSize;
+		from->blockSize = 0;
+		recount(from);
+		recount(to);
+	}
+	void moveToFront(Node *from, Node *to) //prepend all elements of from to to
+	{
+		detach(from);
+		detach(to);
+		to->first = (to->first + to->capacity - from->blockSize) % to->capacity;
+		moveSlots(to, 0, from, 0, from->blockSize);
+		to->blockSize += from->blockSize;
+		from->blockSize = 0;
+		recount(from);
+		recount(to);
+	}
+	iterator removeNode(Node *n, size_t pos) //returns the position of the element after the removed one
+	{
+		detach(n);
+		n->slot(pos)->~T();
+		if (pos < n->blockSize - 1 - pos) //close the gap from whichever side is shorter
 		{
-			Node *tmp = pos.node->next;
-			removeNode(pos.node, pos.index);
-			return iterator(0, tmp, this);
+			moveSlots(n, 1, n, 0, pos);
+			n->first = n->first + 1 == n->capacity ? 0 : n->first + 1;
 		}
 		else
+			moveSlots(n, pos, n, pos + 1, n->blockSize - 1 - pos);
+		--n->blockSize;
+		--curLength;
+		Node *p = n->prev, *q = n->next;
+		if (n->blockSize == 0)
+		{
+			deleteNode(n);
+			return iterator(0, q, this);
+		}
+		if (n->blockSize * 4 < n->capacity) //an underfull block is merged into a neighbour that stays at most half full
 		{
-			removeNode(pos.node, pos.index);
-			return iterator(pos.index, pos.node, this);
+			if (p != &head && p->blockSize + n->blockSize <= p->capacity / 2)
+			{
+				size_t offset = p->blockSize;
+				bool last = pos == n->blockSize;
+				moveToBack(n, p);
+				deleteNode(n);
+				return last ? iterator(0, q, this) : iterator(offset + pos, p, this);
+			}
+			if (q != &tail && q->blockSize + n->blockSize <= q->capacity / 2)
+			{
+				moveToFront(n, q);
+				deleteNode(n);
+				return iterator(pos, q, this);
+			}
 		}
+		recount(n);
+		return pos == n->blockSize ? iterator(0, q, this) : iterator(pos, n, this);
 	}
 
-	void push_back(const T &value)
+  public:
+	deque() : small(reinterpret_cast<T *>(smallStorage), SmallSize), curLength(0), pool(NULL), poolSize(0), poolLimit(DEQUE_POOL_BLOCKS), blocks(NULL), sizeTree(NULL), indexCapacity(0), cursor(NULL), cursorStart(0), copyOnWrite(false), hugePages(false)
 	{
-		if (!empty())
+		head.next = &tail;
+		tail.prev = &head;
+	}
+	deque(const deque &other) : small(reinterpret_cast<T *>(smallStorage), SmallSize), curLength(0), pool(NULL), poolSize(0), poolLimit(DEQUE_POOL_BLOCKS), blocks(NULL), sizeTree(NULL), indexCapacity(0), cursor(NULL), cursorStart(0), copyOnWrite(false), hugePages(false)
+	{
+		head.next = &tail;
+		tail.prev = &head;
+		hugePages = other.hugePages;
+		copyFrom(other);
+	}
+
+	deque(deque &&other) noexcept(std::is_nothrow_move_constructible<T>::value) : small(reinterpret_cast<T *>(smallStorage), SmallSize), curLength(0), pool(NULL), poolSize(0), poolLimit(DEQUE_POOL_BLOCKS), blocks(NULL), sizeTree(NULL), indexCapacity(0), cursor(NULL), cursorStart(0), copyOnWrite(false), hugePages(false)
+	{
+		head.next = &tail;
+		tail.prev = &head;
+		stealFrom(other);
+	}
+
+	~deque()
+	{
+		clear();
+		shrink_to_fit();
+		delete[] blocks;
+		delete[] sizeTree;
+	}
+
+	deque &operator=(const deque &other)
+	{
+		if (this == &other)
+			return *this;
+		clear();
+		set_huge_pages(other.hugePages); //as the copy constructor, the copy allocates like other
+		copyFrom(other);
+		return *this;
+	}
+	deque &operator=(deque &&other) noexcept(std::is_nothrow_move_constructible<T>::value)
+	{
+		if (this == &other)
+			return *this;
+		clear();
+		stealFrom(other);
+		return *this;
+	}
+	void swap(deque &other) noexcept(std::is_nothrow_move_constructible<T>::value) //O(1), only the inline blocks' elements are moved
+	{
+		deque tmp(std::move(other));
+		other = std::move(*this);
+		*this = std::move(tmp);
+	}
+
+	T &at(const size_t &pos)
+	{
+		if (pos < size())
 		{
-			addNode(tail->prev, tail->prev->blockSize, value);
+			size_t offset;
+			Node *cur_p = seek(pos, offset);
+			leak(cur_p);
+			return *(cur_p->slot(offset));
 		}
 		else
+			throw index_out_of_bound();
+	}
+	const T &at(const size_t &pos) const //no cursor, see the counted block index
+	{
+		if (pos < size())
 		{
-			addNode(tail, 0, value);
+			size_t offset;
+			const Node *cur_p = findNode(pos, offset);
+			return *(cur_p->slot(offset));
 		}
+		else
+			throw index_out_of_bound();
 	}
-
-	void pop_back()
+	T &operator[](const size_t &pos)
+	{
+		if (pos < size())
+		{
+			size_t offset;
+			Node *cur_p = seek(pos, offset);
+			leak(cur_p);
+			return *(cur_p->slot(offset));
+		}
+		else
+			throw index_out_of_bound();
+	}
+	const T &operator[](const size_t &pos) const //no cursor, see the counted block index
 	{
+		if (pos < size())
+		{
+			size_t offset;
+			const Node *cur_p = findNode(pos, offset);
+			return *(cur_p->slot(offset));
+		}
+		else
+			throw index_out_of_bound();
+	}
 
+	T &front()
+	{
 		if (!empty())
 		{
-			removeNode(tail->prev, tail->prev->blockSize - 1);
+			leak(head.next);
+			return *(head.next->slot(0));
 		}
 		else
 			throw container_is_empty();
 	}
-
-	void push_front(const T &value)
+	const T &front() const
 	{
-		addNode(head->next, 0, value);
+		if (!empty())
+			return *(head.next->slot(0));
+		else
+			throw container_is_empty();
 	}
 
-	void pop_front()
+	T &back()
+	{
+		if (!empty())
+		{
+			leak(tail.prev);
+			return *(tail.prev->slot(tail.prev->blockSize - 1));
+		}
+		else
+			throw container_is_empty();
+	}
+	const T &back() const
 	{
 		if (!empty())
 		{
-			removeNode(head->next, 0);
+			return *(tail.prev->slot(tail.prev->blockSize - 1));
 		}
 		else
 			throw container_is_empty();
 	}
-	Node *getHead() const { return head; }
-	Node *getTail() const { return tail; }
+
+	iterator begin()
+	{
+		return iterator(0, head.next, this);
+	}
+	const_iterator begin() const
+	{
+		return cbegin();
+	}
+	const_iterator cbegin() const
+	{
+		return const_iterator(0, head.next, this);
+	}
+
+	iterator end()
+	{
+		return iterator(0, &tail, this);
+	}
+	const_iterator end() const
+	{
+		return cend();
+	}
+	const_iterator cend() const
+	{
+		return const_iterator(0, &tail, this);
+	}
+
+	/*
+	 * Segmented iteration: f(first, last) is called once per contiguous run of
+	 * elements, in order. A block contributes at most two runs since it is a ring
+	 * buffer, so f can loop over plain pointers without any per-element checks.
+	 */
+	template <class F>
+	F for_each_segment(F f)
+	{
+		return for_each_segment(begin(), end(), f);
+	}
+	template <class F>
+	F for_each_segment(F f) const
+	{
+		return for_each_segment(cbegin(), cend(), f);
+	}
+	template <class F>
+	F for_each_segment(iterator first, iterator last, F f)
+	{
+		if (first.container != this || last.container != this || first.node == NULL || last.node == NULL || last < first)
+			throw invalid_iterator();
+		for (Node *n = first.node; n != last.node; n = n->next, first.index = 0)
+		{
+			leak(n);
+			visitRuns(n, first.index, n->blockSize, f);
+		}
+		if (last.node != &tail)
+		{
+			leak(last.node);
+			visitRuns(last.node, first.index, last.index, f);
+		}
+		return f;
+	}
+	template <class F>
+	F for_each_segment(const_iterator first, const_iterator last, F f) const
+	{
+		if (first.container != this || last.container != this || first.node == NULL || last.node == NULL || last < first)
+			throw invalid_iterator();
+		for (const Node *n = first.node; n != last.node; n = n->next, first.index = 0)
+			visitRuns(n, first.index, n->blockSize, f);
+		if (last.node != &tail)
+			visitRuns(last.node, first.index, last.index, f);
+		return f;
+	}
+
+	/*
+	 * Scans for arithmetic element types. They run the kernels of simd.hpp over each
+	 * contiguous run, so int32_t and float are vectorized.
+	 */
+	const_iterator find(const T &value) const
+	{
+		static_assert(std::is_arithmetic<T>::value, "find() needs an arithmetic element type");
+		for (const Node *n = head.next; n != &tail; n = n->next)
+		{
+			size_t c = run(n, 0, n->blockSize);
+			const T *p = simd::find(n->slot(0), n->slot(0) + c, value);
+			if (p != n->slot(0) + c)
+				return const_iterator(p - n->slot(0), n, this);
+			if (c < n->blockSize) //the part of the ring that wrapped around
+			{
+				p = simd::find(n->slot(c), n->slot(c) + (n->blockSize - c), value);
+				if (p != n->slot(c) + (n->blockSize - c))
+					return const_iterator(c + (p - n->slot(c)), n, this);
+			}
+		}
+		return cend();
+	}
+	iterator find(const T &value)
+	{
+		const_iterator res = static_cast<const deque *>(this)->find(value);
+		return iterator(res.index, const_cast<Node *>(res.node), this);
+	}
+	size_t count(const T &value) const
+	{
+		static_assert(std::is_arithmetic<T>::value, "count() needs an arithmetic element type");
+		size_t res = 0;
+		for_each_segment([&](const T *first, const T *last) { res += simd::count(first, last, value); });
+		return res;
+	}
+	T sum() const //signed integers wrap around on overflow
+	{
+		static_assert(std::is_arithmetic<T>::value, "sum() needs an arithmetic element type");
+		typedef typename simd::sum_type<T>::type acc_t;
+		acc_t res = acc_t();
+		for_each_segment([&](const T *first, const T *last) { res += acc_t(simd::sum(first, last)); });
+		return T(res);
+	}
+	T min() const
+	{
+		static_assert(std::is_arithmetic<T>::value, "min() needs an arithmetic element type");
+		if (empty())
+			throw container_is_empty();
+		T res = front();
+		for_each_segment([&](const T *first, const T *last) { res = simd::min(first, last, res); });
+		return res;
+	}
+	T max() const
+	{
+		static_assert(std::is_arithmetic<T>::value, "max() needs an arithmetic element type");
+		if (empty())
+			throw container_is_empty();
+		T res = front();
+		for_each_segment([&](const T *first, const T *last) { res = simd::max(first, last, res); });
+		return res;
+	}
+
+	bool empty() const
+	{
+		return curLength == 0;
+	}
+
+	size_t size() const
+	{
+		return curLength;
+	}
+
+	/*
+	 * Blocks freed by pops and erases are kept in a per-deque pool of up to
+	 * pool_limit() blocks and reused before asking the allocator for new ones.
+	 */
+	void reserve(size_t n) //make room for n elements in total without further allocation
+	{
+		if (n <= curLength)
+			return;
+		size_t need = (n - curLength + BlockSize - 1) / BlockSize;
+		if (poolLimit < need)
+			poolLimit = need;
+		while (poolSize < need)
+		{
+			Node *p = allocBlock();
+			p->next = pool;
+			pool = p;
+			++poolSize;
+		}
+	}
+	void shrink_to_fit() //return the pooled blocks to the allocator
+	{
+		while (pool)
+		{
+			Node *p = pool;
+			pool = pool->next;
+			freeBlock(p);
+		}
+		poolSize = 0;
+	}
+	size_t pool_limit() const
+	{
+		return poolLimit;
+	}
+	void set_pool_limit(size_t n)
+	{
+		poolLimit = n;
+		while (poolSize > poolLimit)
+		{
+			Node *p = pool;
+			pool = pool->next;
+			freeBlock(p);
+			--poolSize;
+		}
+	}
+
+	bool copy_on_write() const
+	{
+		return copyOnWrite;
+	}
+	void set_copy_on_write(bool on) //turning it off gives every block a private copy first
+	{
+		if (!on)
+			for (Node *p = head.next; p != &tail; p = p->next)
+				detach(p);
+		copyOnWrite = on;
+	}
+
+	bool huge_pages() const
+	{
+		return hugePages;
+	}
+	void set_huge_pages(bool on) //affects blocks allocated from now on, the pool is emptied so they really are new
+	{
+		if (on != hugePages)
+			shrink_to_fit();
+		hugePages = on;
+	}
+	static slab_stats huge_page_stats() //counters of the arena shared by all deques with this block size
+	{
+		return arena::instance().stats();
+	}
+
+	void compact() //repack the elements into as few blocks as possible in one pass
+	{
+		for (Node *dst = head.next; dst != &tail; dst = dst->next)
+		{
+			Node *src = dst->next;
+			while (dst->blockSize < dst->capacity && src != &tail)
+			{
+				size_t k = dst->capacity - dst->blockSize;
+				if (k > src->blockSize)
+					k = src->blockSize;
+				detach(dst);
+				detach(src);
+				moveSlots(dst, dst->blockSize, src, 0, k);
+				dst->blockSize += k;
+				src->blockSize -= k;
+				src->first = (src->first + k) % src->capacity;
+				if (src->blockSize == 0)
+				{
+					Node *nx = src->next;
+					deleteNode(src);
+					src = nx;
+				}
+			}
+		}
+		for (Node *p = head.next; p != &tail; p = p->next)
+			recount(p);
+	}
+
+	void clear()
+	{
+		while (head.next != &tail)
+			deleteNode(head.next);
+		curLength = 0;
+	}
+
+	template <class... Args>
+	iterator emplace(iterator pos, Args &&... args)
+	{
+		if (pos.container != this || pos.node == NULL)
+			throw invalid_iterator();
+		if (pos.node == &tail)
+		{
+			if (!empty())
+				return addNode(tail.prev, tail.prev->blockSize, std::forward<Args>(args)...);
+			else
+				return addNode(&tail, pos.index, std::forward<Args>(args)...);
+		}
+		else
+			return addNode(pos.node, pos.index, std::forward<Args>(args)...);
+	}
+	iterator insert(iterator pos, const T &value)
+	{
+		return emplace(pos, value);
+	}
+	iterator insert(iterator pos, T &&value)
+	{
+		return emplace(pos, std::move(value));
+	}
+	template <class InputIt>
+	typename std::enable_if<!std::is_integral<InputIt>::value, iterator>::type insert(iterator pos, InputIt first, InputIt last)
+	{
+		if (pos.container != this || pos.node == NULL)
+			throw invalid_iterator();
+		return insertRange(pos.node, pos.index, first, last);
+	}
+	iterator insert(iterator pos, size_t n, const T &value)
+	{
+		if (pos.container != this || pos.node == NULL)
+			throw invalid_iterator();
+		if (n == 0)
+			return pos;
+		T tmp(value); //value may live in the block that gets split
+		return insertRange(pos.node, pos.index, fill_iterator(&tmp, n), fill_iterator(&tmp, 0));
+	}
+	template <class InputIt>
+	typename std::enable_if<!std::is_integral<InputIt>::value>::type assign(InputIt first, InputIt last)
+	{
+		clear();
+		insertRange(&tail, 0, first, last);
+	}
+	void assign(size_t n, const T &value)
+	{
+		T tmp(value);
+		clear();
+		insertRange(&tail, 0, fill_iterator(&tmp, n), fill_iterator(&tmp, 0));
+	}
+	void append(const T *data, size_t n) //bulk push_back of a contiguous array
+	{
+		insertRange(&tail, 0, data, data + n);
+	}
+
+	iterator erase(iterator pos)
+	{
+		if (curLength == 0 || pos == end() || pos.container != this || pos.node == NULL)
+			throw invalid_iterator();
+		return removeNode(pos.node, pos.index);
+	}
+	/*
+	 * Blocks fully covered by [first, last) are unlinked whole. The two boundary blocks
+	 * only lose a suffix and a prefix, which a ring buffer drops without shifting; a
+	 * range inside a single block closes the gap from its shorter side.
+	 */
+	iterator erase(iterator first, iterator last)
+	{
+		if (first.container != this || last.container != this || first.node == NULL || last.node == NULL)
+			throw invalid_iterator();
+		if (first == last)
+			return last;
+		if (position(first.node, first.index) > position(last.node, last.index))
+			throw invalid_iterator();
+		Node *a = first.node, *b = last.node;
+		if (a == b)
+		{
+			detach(a);
+			size_t k = last.index - first.index;
+			for (size_t i = first.index; i < last.index; ++i)
+				a->slot(i)->~T();
+			if (first.index < a->blockSize - last.index)
+			{
+				moveSlots(a, k, a, 0, first.index);
+				a->first = (a->first + k) % a->capacity;
+			}
+			else
+				moveSlots(a, first.index, a, last.index, a->blockSize - last.index);
+			a->blockSize -= k;
+			curLength -= k;
+			recount(a);
+			return first.index == a->blockSize ? iterator(0, a->next, this) : first;
+		}
+		curLength -= a->blockSize - first.index;
+		if (first.index)
+		{
+			detach(a);
+			a->dropBack(a->blockSize - first.index);
+		}
+		while (a->next != b)
+		{
+			curLength -= a->next->blockSize;
+			deleteNode(a->next);
+		}
+		recount(a);
+		if (b != &tail)
+		{
+			curLength -= last.index;
+			detach(b);
+			b->dropFront(last.index);
+			recount(b);
+		}
+		if (first.index == 0)
+		{
+			deleteNode(a);
+			return iterator(0, b, this);
+		}
+		if (b != &tail && (a->blockSize * 4 < a->capacity || b->blockSize * 4 < b->capacity) && a->blockSize + b->blockSize <= a->capacity / 2)
+		{
+			size_t offset = a->blockSize;
+			moveToBack(b, a);
+			deleteNode(b);
+			return iterator(offset, a, this);
+		}
+		return iterator(0, b, this);
+	}
+
+	template <class... Args>
+	void emplace_back(Args &&... args)
+	{
+		if (!empty())
+		{
+			addNode(tail.prev, tail.prev->blockSize, std::forward<Args>(args)...);
+		}
+		else
+		{
+			addNode(&tail, 0, std::forward<Args>(args)...);
+		}
+	}
+	void push_back(const T &value)
+	{
+		emplace_back(value);
+	}
+	void push_back(T &&value)
+	{
+		emplace_back(std::move(value));
+	}
+
+	void pop_back()
+	{
+
+		if (!empty())
+		{
+			removeNode(tail.prev, tail.prev->blockSize - 1);
+		}
+		else
+			throw container_is_empty();
+	}
+
+	template <class... Args>
+	void emplace_front(Args &&... args)
+	{
+		addNode(head.next, 0, std::forward<Args>(args)...);
+	}
+	void pop_front_n(size_t n) //drop the first n elements, whole blocks are unlinked at once
+	{
+		if (n > curLength)
+			throw container_is_empty();
+		curLength -= n;
+		while (n && n >= head.next->blockSize)
+		{
+			n -= head.next->blockSize;
+			deleteNode(head.next);
+		}
+		if (n)
+		{
+			detach(head.next);
+			head.next->dropFront(n);
+			recount(head.next);
+		}
+	}
+	void pop_back_n(size_t n) //drop the last n elements
+	{
+		if (n > curLength)
+			throw container_is_empty();
+		curLength -= n;
+		while (n && n >= tail.prev->blockSize)
+		{
+			n -= tail.prev->blockSize;
+			deleteNode(tail.prev);
+		}
+		if (n)
+		{
+			detach(tail.prev);
+			tail.prev->dropBack(n);
+			recount(tail.prev);
+		}
+	}
+	void push_front(const T &value)
+	{
+		emplace_front(value);
+	}
+	void push_front(T &&value)
+	{
+		emplace_front(std::move(value));
+	}
+
+	void pop_front()
+	{
+		if (!empty())
+		{
+			removeNode(head.next, 0);
+		}
+		else
+			throw container_is_empty();
+	}
+	Node *getHead() const { return const_cast<Node *>(&head); }
+	Node *getTail() const { return const_cast<Node *>(&tail); }
+};
+
+template <class T, size_t BlockSize>
+void swap(deque<T, BlockSize> &lhs, deque<T, BlockSize> &rhs) noexcept(noexcept(lhs.swap(rhs)))
+{
+	lhs.swap(rhs);
+}
+
+/*
+ * deque<bool> packs its flags 64 to a word, BlockSize counting bits rounded up to whole
+ * words. Only the two end blocks of a bit deque are ever partly used, so the blocks
+ * sit in a circular directory and element i is found by arithmetic alone. Inserting
+ * or erasing in the middle shifts the bits of the shorter side a word at a time.
+ * References are proxies as in std::vector<bool>; count and find_first work a word at
+ * a time with popcount and count-trailing-zeros. There is no for_each_segment, since
+ * flags have no address to hand out; count and find_first are the bulk scans.
+ */
+template <size_t BlockSize>
+class deque<bool, BlockSize>
+{
+	typedef uint64_t word;
+	static const size_t WordBits = 64;
+	static const size_t Words = (BlockSize + WordBits - 1) / WordBits; //per block
+	static const size_t BlockBits = Words * WordBits;
+
+  public:
+	class reference
+	{
+		friend class deque;
+		word *w;
+		word mask;
+		reference(word *p, word m) : w(p), mask(m) {}
+
+	  public:
+		operator bool() const { return (*w & mask) != 0; }
+		reference &operator=(bool value)
+		{
+			if (value)
+				*w |= mask;
+			else
+				*w &= ~mask;
+			return *this;
+		}
+		reference &operator=(const reference &rhs) { return *this = bool(rhs); }
+		bool operator~() const { return !bool(*this); }
+		void flip() { *w ^= mask; }
+		friend void swap(reference a, reference b) //proxies are swapped by value, as std::iter_swap needs
+		{
+			bool tmp = a;
+			a = bool(b);
+			b = tmp;
+		}
+	};
+	typedef bool const_reference;
+
+	class const_iterator;
+	class iterator
+	{
+	  public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef bool value_type;
+		typedef ptrdiff_t difference_type;
+		typedef void pointer;
+		typedef deque::reference reference;
+
+		size_t index;
+		deque *container;
+		iterator() : index(0), container(NULL) {}
+		iterator(size_t x, deque *id) : index(x), container(id) {}
+
+		iterator operator+(const ptrdiff_t &n) const
+		{
+			iterator tmp = *this;
+			return tmp += n;
+		}
+		iterator operator-(const ptrdiff_t &n) const
+		{
+			iterator tmp = *this;
+			return tmp -= n;
+		}
+		ptrdiff_t operator-(const iterator &rhs) const
+		{
+			if (container == rhs.container)
+				return ptrdiff_t(index) - ptrdiff_t(rhs.index);
+			else
+				throw invalid_iterator();
+		}
+		iterator &operator+=(const ptrdiff_t &n)
+		{
+			ptrdiff_t pos = ptrdiff_t(index) + n;
+			if (pos < 0 || pos > ptrdiff_t(container->size()))
+				throw invalid_iterator();
+			index = size_t(pos);
+			return *this;
+		}
+		iterator &operator-=(const ptrdiff_t &n)
+		{
+			return operator+=(-n);
+		}
+		friend iterator operator+(const ptrdiff_t &n, const iterator &it)
+		{
+			return it + n;
+		}
+		reference operator[](const ptrdiff_t &n) const
+		{
+			return *(*this + n);
+		}
+		bool operator<(const iterator &rhs) const
+		{
+			return *this - rhs < 0;
+		}
+		bool operator>(const iterator &rhs) const
+		{
+			return rhs < *this;
+		}
+		bool operator<=(const iterator &rhs) const
+		{
+			return !(rhs < *this);
+		}
+		bool operator>=(const iterator &rhs) const
+		{
+			return !(*this < rhs);
+		}
+
+		iterator operator++(int)
+		{
+			iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+		iterator &operator++()
+		{
+			if (index == container->size())
+				throw invalid_iterator();
+			++index;
+			return *this;
+		}
+		iterator operator--(int)
+		{
+			iterator tmp = *this;
+			--*this;
+			return tmp;
+		}
+		iterator &operator--()
+		{
+			if (index == 0)
+				throw invalid_iterator();
+			--index;
+			return *this;
+		}
+
+		reference operator*() const
+		{
+			if (index < container->size())
+				return container->ref(index);
+			else
+				throw invalid_iterator();
+		}
+
+		bool operator==(const iterator &rhs) const
+		{
+			return rhs.container == container && rhs.index == index;
+		}
+		bool operator==(const const_iterator &rhs) const
+		{
+			return rhs.container == container && rhs.index == index;
+		}
+		bool operator!=(const iterator &rhs) const
+		{
+			return !(*this == rhs);
+		}
+		bool operator!=(const const_iterator &rhs) const
+		{
+			return !(*this == rhs);
+		}
+	};
+	class const_iterator
+	{
+	  public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef bool value_type;
+		typedef ptrdiff_t difference_type;
+		typedef void pointer;
+		typedef bool reference;
+
+		size_t index;
+		const deque *container;
+		const_iterator() : index(0), container(NULL) {}
+		const_iterator(size_t x, const deque *id) : index(x), container(id) {}
+		const_iterator(const iterator &other) : index(other.index), container(other.container) {}
+
+		const_iterator operator+(const ptrdiff_t &n) const
+		{
+			const_iterator tmp = *this;
+			return tmp += n;
+		}
+		const_iterator operator-(const ptrdiff_t &n) const
+		{
+			const_iterator tmp = *this;
+			return tmp -= n;
+		}
+		ptrdiff_t operator-(const const_iterator &rhs) const
+		{
+			if (container == rhs.container)
+				return ptrdiff_t(index) - ptrdiff_t(rhs.index);
+			else
+				throw invalid_iterator();
+		}
+		const_iterator &operator+=(const ptrdiff_t &n)
+		{
+			ptrdiff_t pos = ptrdiff_t(index) + n;
+			if (pos < 0 || pos > ptrdiff_t(container->size()))
+				throw invalid_iterator();
+			index = size_t(pos);
+			return *this;
+		}
+		const_iterator &operator-=(const ptrdiff_t &n)
+		{
+			return operator+=(-n);
+		}
+		friend const_iterator operator+(const ptrdiff_t &n, const const_iterator &it)
+		{
+			return it + n;
+		}
+		bool operator[](const ptrdiff_t &n) const
+		{
+			return *(*this + n);
+		}
+		bool operator<(const const_iterator &rhs) const
+		{
+			return *this - rhs < 0;
+		}
+		bool operator>(const const_iterator &rhs) const
+		{
+			return rhs < *this;
+		}
+		bool operator<=(const const_iterator &rhs) const
+		{
+			return !(rhs < *this);
+		}
+		bool operator>=(const const_iterator &rhs) const
+		{
+			return !(*this < rhs);
+		}
+
+		const_iterator operator++(int)
+		{
+			const_iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+		const_iterator &operator++()
+		{
+			if (index == container->size())
+				throw invalid_iterator();
+			++index;
+			return *this;
+		}
+		const_iterator operator--(int)
+		{
+			const_iterator tmp = *this;
+			--*this;
+			return tmp;
+		}
+		const_iterator &operator--()
+		{
+			if (index == 0)
+				throw invalid_iterator();
+			--index;
+			return *this;
+		}
+
+		bool operator*() const
+		{
+			if (index < container->size())
+				return container->get(index);
+			else
+				throw invalid_iterator();
+		}
+
+		bool operator==(const const_iterator &rhs) const
+		{
+			return rhs.container == container && rhs.index == index;
+		}
+		bool operator==(const iterator &rhs) const
+		{
+			return rhs.container == container && rhs.index == index;
+		}
+		bool operator!=(const const_iterator &rhs) const
+		{
+			return !(*this == rhs);
+		}
+		bool operator!=(const iterator &rhs) const
+		{
+			return !(*this == rhs);
+		}
+	};
+
+  private:
+	word **blocks; //circular directory, the k-th block is blocks[(firstBlock + k) % directorySize]
+	size_t directorySize;
+	size_t firstBlock;
+	size_t blockCount;
+	size_t start; //bit of the first block that holds element 0
+	size_t curLength;
+	word *spare; //the last retired block, kept for reuse
+
+	static word lowBits(size_t n) //n < WordBits
+	{
+		return (word(1) << n) - 1;
+	}
+	word *blockAt(size_t k) const
+	{
+		k += firstBlock;
+		if (k >= directorySize)
+			k -= directorySize;
+		return blocks[k];
+	}
+	word *wordOf(size_t pos, word &mask) const
+	{
+		size_t a = start + pos;
+		word *b = blockAt(a / BlockBits);
+		a %= BlockBits;
+		mask = word(1) << (a % WordBits);
+		return b + a / WordBits;
+	}
+	bool get(size_t pos) const
+	{
+		word mask;
+		return (*wordOf(pos, mask) & mask) != 0;
+	}
+	reference ref(size_t pos)
+	{
+		word mask;
+		word *w = wordOf(pos, mask);
+		return reference(w, mask);
+	}
+	word *newBlock()
+	{
+		word *b = spare;
+		if (b)
+			spare = NULL;
+		else
+			b = new word[Words];
+		return b;
+	}
+	void retire(word *b)
+	{
+		if (spare == NULL)
+			spare = b;
+		else
+			delete[] b;
+	}
+	void growDirectory()
+	{
+		size_t n = directorySize ? directorySize * 2 : 8;
+		word **d = new word *[n];
+		for (size_t k = 0; k < blockCount; ++k)
+			d[k] = blockAt(k);
+		delete[] blocks;
+		blocks = d;
+		directorySize = n;
+		firstBlock = 0;
+	}
+	void addBlockBack()
+	{
+		if (blockCount == directorySize)
+			growDirectory();
+		size_t k = firstBlock + blockCount;
+		blocks[k >= directorySize ? k - directorySize : k] = newBlock();
+		++blockCount;
+	}
+	void addBlockFront()
+	{
+		if (blockCount == directorySize)
+			growDirectory();
+		firstBlock = firstBlock ? firstBlock - 1 : directorySize - 1;
+		blocks[firstBlock] = newBlock();
+		++blockCount;
+		start += BlockBits;
+	}
+	void trim() //give back the end blocks that no longer hold elements
+	{
+		if (curLength == 0)
+		{
+			while (blockCount)
+				retire(blockAt(--blockCount));
+			start = 0;
+			return;
+		}
+		while (start >= BlockBits)
+		{
+			retire(blocks[firstBlock]);
+			firstBlock = firstBlock + 1 == directorySize ? 0 : firstBlock + 1;
+			--blockCount;
+			start -= BlockBits;
+		}
+		while (start + curLength <= (blockCount - 1) * BlockBits)
+			retire(blockAt(--blockCount));
+	}
+	void copyFrom(const deque &other)
+	{
+		directorySize = other.blockCount;
+		blocks = directorySize ? new word *[directorySize] : NULL;
+		for (size_t k = 0; k < other.blockCount; ++k)
+		{
+			blocks[k] = new word[Words];
+			std::memcpy(blocks[k], other.blockAt(k), sizeof(word) * Words);
+		}
+		blockCount = other.blockCount;
+		start = other.start;
+		curLength = other.curLength;
+	}
+	word readBits(size_t pos, size_t n) const //n <= WordBits flags from pos on, the first in bit 0
+	{
+		word mask;
+		size_t shift = (start + pos) % WordBits;
+		word bits = *wordOf(pos, mask) >> shift;
+		if (shift + n > WordBits)
+			bits |= *wordOf(pos + WordBits - shift, mask) << (WordBits - shift);
+		return n < WordBits ? bits & lowBits(n) : bits;
+	}
+	void writeBits(size_t pos, size_t n, word bits) //flags [pos, pos + n) must lie in one word
+	{
+		word mask;
+		word *w = wordOf(pos, mask);
+		size_t shift = (start + pos) % WordBits;
+		mask = (n < WordBits ? lowBits(n) : ~word(0)) << shift;
+		*w = (*w & ~mask) | ((bits << shift) & mask);
+	}
+	/*
+	 * Copy n flags of src from position from to position dst of this deque. Each step
+	 * fills the rest of one destination word, reading at most two source words. The
+	 * ranges may overlap, so a copy to a higher position runs backwards.
+	 */
+	void copyBits(size_t dst, const deque &src, size_t from, size_t n)
+	{
+		if (&src != this || dst < from)
+			for (size_t i = 0; i < n;)
+			{
+				size_t k = WordBits - (start + dst + i) % WordBits;
+				if (k > n - i)
+					k = n - i;
+				writeBits(dst + i, k, src.readBits(from + i, k));
+				i += k;
+			}
+		else if (dst > from)
+			for (size_t i = n; i > 0;)
+			{
+				size_t k = (start + dst + i) % WordBits;
+				if (k == 0)
+					k = WordBits;
+				if (k > i)
+					k = i;
+				i -= k;
+				writeBits(dst + i, k, readBits(from + i, k));
+			}
+	}
+	void fillBits(size_t pos, size_t n, bool value)
+	{
+		for (size_t i = 0; i < n;)
+		{
+			size_t k = WordBits - (start + pos + i) % WordBits;
+			if (k > n - i)
+				k = n - i;
+			writeBits(pos + i, k, value ? ~word(0) : 0);
+			i += k;
+		}
+	}
+	void openGap(size_t p, size_t n) //make room for n flags before the p-th one, the shorter side moves
+	{
+		if (p < curLength / 2)
+		{
+			while (start < n)
+				addBlockFront();
+			start -= n;
+			curLength += n;
+			copyBits(0, *this, n, p);
+		}
+		else
+		{
+			while (start + curLength + n > blockCount * BlockBits)
+				addBlockBack();
+			curLength += n;
+			copyBits(p + n, *this, p, curLength - n - p);
+		}
+	}
+	template <class F>
+	size_t scanWords(size_t lo, size_t hi, F f) const //f(bits, n, pos) on [lo, hi) a word at a time until it returns true; where it stopped
+	{
+		while (lo < hi)
+		{
+			size_t a = start + lo;
+			const word *b = blockAt(a / BlockBits);
+			a %= BlockBits;
+			size_t shift = a % WordBits;
+			size_t n = WordBits - shift < hi - lo ? WordBits - shift : hi - lo;
+			word bits = b[a / WordBits] >> shift;
+			if (n < WordBits)
+				bits &= lowBits(n);
+			if (f(bits, n, lo))
+				return lo;
+			lo += n;
+		}
+		return hi;
+	}
+	size_t countBlock(const word *b, size_t lo, size_t hi) const //set bits among bits [lo, hi) of one block
+	{
+		size_t wl = lo / WordBits, wh = hi / WordBits;
+		if (wl == wh)
+			return simd::popcount((b[wl] >> (lo % WordBits)) & lowBits(hi - lo));
+		size_t res = simd::popcount(b[wl] >> (lo % WordBits));
+		res += simd::popcount(b + wl + 1, b + wh);
+		if (hi % WordBits)
+			res += simd::popcount(b[wh] & lowBits(hi % WordBits));
+		return res;
+	}
+
+  public:
+	deque() : blocks(NULL), directorySize(0), firstBlock(0), blockCount(0), start(0), curLength(0), spare(NULL) {}
+	deque(const deque &other) : blocks(NULL), directorySize(0), firstBlock(0), blockCount(0), start(0), curLength(0), spare(NULL)
+	{
+		copyFrom(other);
+	}
+	deque(deque &&other) noexcept : blocks(NULL), directorySize(0), firstBlock(0), blockCount(0), start(0), curLength(0), spare(NULL)
+	{
+		swap(other);
+	}
+	~deque()
+	{
+		clear();
+		delete[] spare;
+		delete[] blocks;
+	}
+	deque &operator=(const deque &other)
+	{
+		if (this != &other)
+		{
+			deque tmp(other);
+			swap(tmp);
+		}
+		return *this;
+	}
+	deque &operator=(deque &&other) noexcept
+	{
+		if (this != &other)
+		{
+			clear();
+			swap(other);
+		}
+		return *this;
+	}
+	void swap(deque &other) noexcept
+	{
+		std::swap(blocks, other.blocks);
+		std::swap(directorySize, other.directorySize);
+		std::swap(firstBlock, other.firstBlock);
+		std::swap(blockCount, other.blockCount);
+		std::swap(start, other.start);
+		std::swap(curLength, other.curLength);
+		std::swap(spare, other.spare);
+	}
+
+	reference at(const size_t &pos)
+	{
+		if (pos < size())
+			return ref(pos);
+		else
+			throw index_out_of_bound();
+	}
+	bool at(const size_t &pos) const
+	{
+		if (pos < size())
+			return get(pos);
+		else
+			throw index_out_of_bound();
+	}
+	reference operator[](const size_t &pos)
+	{
+		return at(pos);
+	}
+	bool operator[](const size_t &pos) const
+	{
+		return at(pos);
+	}
+	bool front() const
+	{
+		if (!empty())
+			return get(0);
+		else
+			throw container_is_empty();
+	}
+	bool back() const
+	{
+		if (!empty())
+			return get(curLength - 1);
+		else
+			throw container_is_empty();
+	}
+
+	iterator begin()
+	{
+		return iterator(0, this);
+	}
+	const_iterator begin() const
+	{
+		return cbegin();
+	}
+	const_iterator cbegin() const
+	{
+		return const_iterator(0, this);
+	}
+	iterator end()
+	{
+		return iterator(curLength, this);
+	}
+	const_iterator end() const
+	{
+		return cend();
+	}
+	const_iterator cend() const
+	{
+		return const_iterator(curLength, this);
+	}
+
+	size_t count(bool value = true) const
+	{
+		size_t ones = 0;
+		for (size_t a = start, e = start + curLength; a < e;)
+		{
+			size_t lo = a % BlockBits;
+			size_t hi = BlockBits - lo < e - a ? BlockBits : lo + (e - a);
+			ones += countBlock(blockAt(a / BlockBits), lo, hi);
+			a += hi - lo;
+		}
+		return value ? ones : curLength - ones;
+	}
+	size_t find_first(bool value = true, size_t from = 0) const //position of the first such flag at or after from, size() if none
+	{
+		size_t hit = 0;
+		size_t stop = scanWords(from, curLength, [&](word bits, size_t n, size_t) {
+			if (!value)
+				bits = ~bits & (n < WordBits ? lowBits(n) : ~word(0));
+			if (bits == 0)
+				return false;
+			hit = simd::ctz(bits);
+			return true;
+		});
+		return stop == curLength ? stop : stop + hit;
+	}
+	const_iterator find(bool value) const
+	{
+		return const_iterator(find_first(value), this);
+	}
+	iterator find(bool value)
+	{
+		return iterator(find_first(value), this);
+	}
+
+	bool empty() const
+	{
+		return curLength == 0;
+	}
+	size_t size() const
+	{
+		return curLength;
+	}
+	void clear()
+	{
+		curLength = 0;
+		trim();
+	}
+
+	template <class... Args>
+	iterator emplace(iterator pos, Args &&... args)
+	{
+		return insert(pos, bool(std::forward<Args>(args)...));
+	}
+	iterator insert(iterator pos, bool value)
+	{
+		if (pos.container != this || pos.index > curLength)
+			throw invalid_iterator();
+		openGap(pos.index, 1);
+		ref(pos.index) = value;
+		return pos;
+	}
+	iterator insert(iterator pos, size_t n, bool value)
+	{
+		if (pos.container != this || pos.index > curLength)
+			throw invalid_iterator();
+		openGap(pos.index, n);
+		fillBits(pos.index, n, value);
+		return pos;
+	}
+	template <class InputIt>
+	typename std::enable_if<!std::is_integral<InputIt>::value, iterator>::type insert(iterator pos, InputIt first, InputIt last)
+	{
+		if (pos.container != this || pos.index > curLength)
+			throw invalid_iterator();
+		deque tmp; //the flags are packed first, so that input iterators are read once and the gap opened once
+		for (; first != last; ++first)
+			tmp.push_back(*first);
+		openGap(pos.index, tmp.curLength);
+		copyBits(pos.index, tmp, 0, tmp.curLength);
+		return pos;
+	}
+	template <class InputIt>
+	typename std::enable_if<!std::is_integral<InputIt>::value>::type assign(InputIt first, InputIt last)
+	{
+		clear();
+		for (; first != last; ++first)
+			push_back(*first);
+	}
+	void assign(size_t n, bool value)
+	{
+		clear();
+		insert(end(), n, value);
+	}
+	void append(const bool *data, size_t n) //bulk push_back of a contiguous array
+	{
+		for (size_t i = 0; i < n; ++i)
+			push_back(data[i]);
+	}
+
+	iterator erase(iterator pos)
+	{
+		if (pos.container != this || pos.index >= curLength)
+			throw invalid_iterator();
+		return erase(pos, pos + 1);
+	}
+	iterator erase(iterator first, iterator last) //the shorter side is shifted over the gap
+	{
+		if (first.container != this || last.container != this || last.index > curLength || last.index < first.index)
+			throw invalid_iterator();
+		size_t p = first.index, k = last.index - first.index;
+		if (p < curLength - p - k)
+		{
+			copyBits(k, *this, 0, p);
+			pop_front_n(k);
+		}
+		else
+		{
+			copyBits(p, *this, p + k, curLength - p - k);
+			pop_back_n(k);
+		}
+		return first;
+	}
+
+	template <class... Args>
+	void emplace_back(Args &&... args)
+	{
+		push_back(bool(std::forward<Args>(args)...));
+	}
+	template <class... Args>
+	void emplace_front(Args &&... args)
+	{
+		push_front(bool(std::forward<Args>(args)...));
+	}
+	void push_back(bool value)
+	{
+		if (start + curLength == blockCount * BlockBits)
+			addBlockBack();
+		++curLength;
+		ref(curLength - 1) = value;
+	}
+	void push_front(bool value)
+	{
+		if (start == 0)
+			addBlockFront();
+		--start;
+		++curLength;
+		ref(0) = value;
+	}
+	void pop_back()
+	{
+		pop_back_n(1);
+	}
+	void pop_front()
+	{
+		pop_front_n(1);
+	}
+	void pop_front_n(size_t n) //drop the first n flags
+	{
+		if (n > curLength)
+			throw container_is_empty();
+		start += n;
+		curLength -= n;
+		trim();
+	}
+	void pop_back_n(size_t n) //drop the last n flags
+	{
+		if (n > curLength)
+			throw container_is_empty();
+		curLength -= n;
+		trim();
+	}
 };
 
 } // namespace sjtu
@@ -0,0 +1,864 @@
+#ifndef SJTU_FIXED_DEQUE_HPP
+#define SJTU_FIXED_DEQUE_HPP
+
+#include "exceptions.hpp"
+#include <cstring>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+namespace sjtu
+{
+/*
+ * fixed_deque has the same interface as deque, but stores its elements in equal-size
+ * blocks addressed through a central map of block pointers. Element i lives at the
+ * absolute position start + i, so operator[], at and iterator jumps are O(1).
+ * Insertion and erasure in the middle shift the elements towards the closer end.
+ * Use it for push/pop-only buffers, and deque when middle insertion is frequent.
+ */
+template <class T>
+class fixed_deque
+{
+	static constexpr size_t floorPow2(size_t x)
+	{
+		return x < 2 ? 1 : 2 * floorPow2(x / 2);
+	}
+
+  public:
+	static constexpr size_t BLOCK_SIZE = floorPow2(4096 / sizeof(T)); //power of two, so positions split with shifts
+	class const_iterator;
+	struct Block
+	{
+		alignas(T) unsigned char storage[sizeof(T) * BLOCK_SIZE];
+	};
+	class iterator
+	{
+	  public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef ptrdiff_t difference_type;
+		typedef T * pointer;
+		typedef T & reference;
+
+		size_t pos; //absolute position in the map
+		fixed_deque<T> *container;
+		iterator() : pos(0), container(NULL) {}
+		iterator(size_t x, fixed_deque<T> *id) : pos(x), container(id) {}
+		iterator(const iterator &rhs) : pos(rhs.pos), container(rhs.container) {}
+
+	  public:
+		iterator operator+(const ptrdiff_t &n) const
+		{
+			iterator tmp = *this;
+			return tmp += n;
+		}
+		iterator operator-(const ptrdiff_t &n) const
+		{
+			iterator tmp = *this;
+			return tmp -= n;
+		}
+		ptrdiff_t operator-(const iterator &rhs) const
+		{
+			if (container == rhs.container)
+				return ptrdiff_t(pos) - ptrdiff_t(rhs.pos);
+			else
+				throw invalid_iterator();
+		}
+		iterator &operator+=(const ptrdiff_t &n)
+		{
+			size_t p = pos + n;
+			if (p < container->start || p > container->start + container->curLength)
+				throw invalid_iterator();
+			pos = p;
+			return *this;
+		}
+		iterator &operator-=(const ptrdiff_t &n)
+		{
+			return operator+=(-n);
+		}
+		friend iterator operator+(const ptrdiff_t &n, const iterator &it)
+		{
+			return it + n;
+		}
+		T & operator[](const ptrdiff_t &n) const
+		{
+			return *(*this + n);
+		}
+		bool operator<(const iterator &rhs) const
+		{
+			return *this - rhs < 0;
+		}
+		bool operator>(const iterator &rhs) const
+		{
+			return rhs < *this;
+		}
+		bool operator<=(const iterator &rhs) const
+		{
+			return !(rhs < *this);
+		}
+		bool operator>=(const iterator &rhs) const
+		{
+			return !(*this < rhs);
+		}
+
+		iterator operator++(int)
+		{
+			iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+
+		iterator &operator++()
+		{
+			if (pos < container->start + container->curLength)
+			{
+				++pos;
+				return *this;
+			}
+			else
+				throw invalid_iterator();
+		}
+
+		iterator operator--(int)
+		{
+			iterator tmp = *this;
+			--*this;
+			return tmp;
+		}
+
+		iterator &operator--()
+		{
+			if (pos > container->start)
+			{
+				--pos;
+				return *this;
+			}
+			else
+				throw invalid_iterator();
+		}
+
+		T &operator*() const
+		{
+			if (pos < container->start + container->curLength)
+				return *(container->slot(pos));
+			else
+				throw invalid_iterator();
+		}
+
+		T *operator->() const noexcept
+		{
+			return &(operator*());
+		}
+
+		bool operator==(const iterator &rhs) const
+		{
+			return rhs.container == container && rhs.pos == pos;
+		}
+		bool operator==(const const_iterator &rhs) const
+		{
+			return rhs.container == container && rhs.pos == pos;
+		}
+
+		bool operator!=(const iterator &rhs) const
+		{
+			return rhs.container != container || rhs.pos != pos;
+		}
+		bool operator!=(const const_iterator &rhs) const
+		{
+			return rhs.container != container || rhs.pos != pos;
+		}
+	};
+	class const_iterator
+	{
+	  public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef ptrdiff_t difference_type;
+		typedef const T * pointer;
+		typedef const T & reference;
+
+		size_t pos;
+		const fixed_deque<T> *container;
+		const_iterator() : pos(0), container(NULL) {}
+		const_iterator(size_t x, const fixed_deque<T> *id) : pos(x), container(id) {}
+		const_iterator(const iterator &other) : pos(other.pos), container(other.container) {}
+		const_iterator(const const_iterator &other) : pos(other.pos), container(other.container) {}
+
+	  public:
+		const_iterator operator+(const ptrdiff_t &n) const
+		{
+			const_iterator tmp = *this;
+			return tmp += n;
+		}
+		const_iterator operator-(const ptrdiff_t &n) const
+		{
+			const_iterator tmp = *this;
+			return tmp -= n;
+		}
+		ptrdiff_t operator-(const const_iterator &rhs) const
+		{
+			if (container == rhs.container)
+				return ptrdiff_t(pos) - ptrdiff_t(rhs.pos);
+			else
+				throw invalid_iterator();
+		}
+		const_iterator &operator+=(const ptrdiff_t &n)
+		{
+			size_t p = pos + n;
+			if (p < container->start || p > container->start + container->curLength)
+				throw invalid_iterator();
+			pos = p;
+			return *this;
+		}
+		const_iterator &operator-=(const ptrdiff_t &n)
+		{
+			return operator+=(-n);
+		}
+		friend const_iterator operator+(const ptrdiff_t &n, const const_iterator &it)
+		{
+			return it + n;
+		}
+		const T & operator[](const ptrdiff_t &n) const
+		{
+			return *(*this + n);
+		}
+		bool operator<(const const_iterator &rhs) const
+		{
+			return *this - rhs < 0;
+		}
+		bool operator>(const const_iterator &rhs) const
+		{
+			return rhs < *this;
+		}
+		bool operator<=(const const_iterator &rhs) const
+		{
+			return !(rhs < *this);
+		}
+		bool operator>=(const const_iterator &rhs) const
+		{
+			return !(*this < rhs);
+		}
+
+		const_iterator operator++(int)
+		{
+			const_iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+
+		const_iterator &operator++()
+		{
+			if (pos < container->start + container->curLength)
+			{
+				++pos;
+				return *this;
+			}
+			else
+				throw invalid_iterator();
+		}
+
+		const_iterator operator--(int)
+		{
+			const_iterator tmp = *this;
+			--*this;
+			return tmp;
+		}
+
+		const_iterator &operator--()
+		{
+			if (pos > container->start)
+			{
+				--pos;
+				return *this;
+			}
+			else
+				throw invalid_iterator();
+		}
+
+		const T &operator*() const
+		{
+			if (pos < container->start + container->curLength)
+				return *(container->slot(pos));
+			else
+				throw invalid_iterator();
+		}
+
+		const T *operator->() const noexcept
+		{
+			return &(operator*());
+		}
+
+		bool operator==(const iterator &rhs) const
+		{
+			return rhs.container == container && rhs.pos == pos;
+		}
+		bool operator==(const const_iterator &rhs) const
+		{
+			return rhs.container == container && rhs.pos == pos;
+		}
+
+		bool operator!=(const iterator &rhs) const
+		{
+			return rhs.container != container || rhs.pos != pos;
+		}
+		bool operator!=(const const_iterator &rhs) const
+		{
+			return rhs.container != container || rhs.pos != pos;
+		}
+	};
+
+	/*....................................................................................*/
+  private:
+	T **map;
+	size_t mapSize;
+	size_t start; //absolute position of the first element
+	size_t curLength;
+
+	T *slot(size_t pos) const
+	{
+		return map[pos / BLOCK_SIZE] + pos % BLOCK_SIZE;
+	}
+	static void relocate(T *dst, T *src) //move an element to uninitialized storage and destroy the source
+	{
+		new (dst) T(std::move(*src));
+		src->~T();
+	}
+	void allocBlock(size_t pos) //make sure the block holding pos exists
+	{
+		if (map[pos / BLOCK_SIZE] == NULL)
+			map[pos / BLOCK_SIZE] = reinterpret_cast<T *>(new Block);
+	}
+	void freeBlock(size_t pos)
+	{
+		delete reinterpret_cast<Block *>(map[pos / BLOCK_SIZE]);
+		map[pos / BLOCK_SIZE] = NULL;
+	}
+	void reallocateMap() //recenter the used blocks, doubling the map if it is more than half full
+	{
+		size_t firstBlock = start / BLOCK_SIZE;
+		size_t usedBlocks = curLength ? (start + curLength - 1) / BLOCK_SIZE - firstBlock + 1 : 0;
+		size_t newSize = mapSize;
+		if (mapSize < usedBlocks * 2 + 2)
+			newSize = mapSize * 2 + 2;
+		size_t newFirst = (newSize - usedBlocks) / 2;
+		if (newSize == mapSize)
+		{
+			memmove(map + newFirst, map + firstBlock, usedBlocks * sizeof(T *));
+			for (size_t i = 0; i < newFirst; ++i)
+				map[i] = NULL;
+			for (size_t i = newFirst + usedBlocks; i < mapSize; ++i)
+				map[i] = NULL;
+		}
+		else
+		{
+			T **newMap = new T *[newSize];
+			for (size_t i = 0; i < newSize; ++i)
+				newMap[i] = NULL;
+			if (usedBlocks)
+				memcpy(newMap + newFirst, map + firstBlock, usedBlocks * sizeof(T *));
+			delete[] map;
+			map = newMap;
+			mapSize = newSize;
+		}
+		start = newFirst * BLOCK_SIZE + start % BLOCK_SIZE;
+	}
+	void growBack() //make room for one element after the last one
+	{
+		if ((start + curLength) / BLOCK_SIZE >= mapSize)
+			reallocateMap();
+		allocBlock(start + curLength);
+	}
+	void growFront() //make room for one element before the first one
+	{
+		if (start == 0)
+			reallocateMap();
+		allocBlock(start - 1);
+	}
+	void shrinkBack() //the slot after the last element has just been vacated
+	{
+		size_t pos = start + curLength;
+		if (curLength == 0 || pos % BLOCK_SIZE == 0)
+			freeBlock(pos);
+	}
+	void shrinkFront() //the slot before the first element has just been vacated
+	{
+		if (curLength == 0 || start % BLOCK_SIZE == 0)
+			freeBlock(start - 1);
+	}
+	void dropBlocks(size_t lo, size_t hi) //free the blocks over [lo, hi) that no element lives in anymore
+	{
+		for (size_t b = lo / BLOCK_SIZE; b * BLOCK_SIZE < hi; ++b)
+			if (curLength == 0 || b < start / BLOCK_SIZE || b > (start + curLength - 1) / BLOCK_SIZE)
+				freeBlock(b * BLOCK_SIZE);
+	}
+	void reverse(size_t lo, size_t hi) //reverse the elements at absolute positions [lo, hi)
+	{
+		for (; lo + 1 < hi; ++lo, --hi)
+			std::swap(*slot(lo), *slot(hi - 1));
+	}
+	class fill_iterator //yields the same value count times, feeds insert(pos, n, value) into insertRange
+	{
+		const T *value;
+		size_t count;
+
+	  public:
+		fill_iterator(const T *v, size_t n) : value(v), count(n) {}
+		const T &operator*() const { return *value; }
+		fill_iterator &operator++()
+		{
+			--count;
+			return *this;
+		}
+		bool operator==(const fill_iterator &rhs) const { return count == rhs.count; }
+		bool operator!=(const fill_iterator &rhs) const { return count != rhs.count; }
+	};
+	/*
+	 * Insert [first, last) before the p-th element. The new elements are pushed at the
+	 * end closer to p, in one pass so that input iterators work, and then rotated into
+	 * place by reversals; only the elements between p and that end move.
+	 */
+	template <class InputIt>
+	iterator insertRange(size_t p, InputIt first, InputIt last)
+	{
+		size_t n = 0;
+		bool atFront = p < curLength / 2;
+		try
+		{
+			for (; first != last; ++first, ++n)
+				if (atFront)
+					emplace_front(*first);
+				else
+					emplace_back(*first);
+		}
+		catch (...)
+		{
+			if (atFront)
+				pop_front_n(n);
+			else
+				pop_back_n(n);
+			throw;
+		}
+		if (atFront) //[new, reversed][p old ones] -> [p old ones][new]
+		{
+			reverse(start, start + n + p);
+			reverse(start, start + p);
+		}
+		else //[old ones from p][new] -> [new][old ones from p]
+		{
+			reverse(start + p, start + curLength);
+			reverse(start + p, start + p + n);
+			reverse(start + p + n, start + curLength);
+		}
+		return iterator(start + p, this);
+	}
+	template <class F, class U>
+	F visitRuns(size_t lo, size_t hi, F f, U *) const //f(first, last) on the part of each block within [lo, hi)
+	{
+		while (lo < hi)
+		{
+			size_t k = BLOCK_SIZE - lo % BLOCK_SIZE < hi - lo ? BLOCK_SIZE - lo % BLOCK_SIZE : hi - lo;
+			U *p = slot(lo);
+			f(p, p + k);
+			lo += k;
+		}
+		return f;
+	}
+	void copyFrom(const fixed_deque &other)
+	{
+		for (size_t i = 0; i < other.curLength; ++i)
+			push_back(*other.slot(other.start + i));
+	}
+
+  public:
+	fixed_deque() : map(NULL), mapSize(0), start(0), curLength(0) {}
+	fixed_deque(const fixed_deque &other) : map(NULL), mapSize(0), start(0), curLength(0)
+	{
+		copyFrom(other);
+	}
+
+	fixed_deque(fixed_deque &&other) noexcept : map(other.map), mapSize(other.mapSize), start(other.start), curLength(other.curLength)
+	{
+		other.map = NULL;
+		other.mapSize = 0;
+		other.start = 0;
+		other.curLength = 0;
+	}
+
+	~fixed_deque()
+	{
+		clear();
+		delete[] map;
+	}
+
+	fixed_deque &operator=(const fixed_deque &other)
+	{
+		if (this == &other)
+			return *this;
+		clear();
+		copyFrom(other);
+		return *this;
+	}
+	fixed_deque &operator=(fixed_deque &&other) noexcept
+	{
+		if (this == &other)
+			return *this;
+		clear();
+		swap(other);
+		return *this;
+	}
+	void swap(fixed_deque &other) noexcept
+	{
+		std::swap(map, other.map);
+		std::swap(mapSize, other.mapSize);
+		std::swap(start, other.start);
+		std::swap(curLength, other.curLength);
+	}
+
+	T &at(const size_t &pos)
+	{
+		if (pos < size())
+			return *slot(start + pos);
+		else
+			throw index_out_of_bound();
+	}
+	const T &at(const size_t &pos) const
+	{
+		if (pos < size())
+			return *slot(start + pos);
+		else
+			throw index_out_of_bound();
+	}
+	T &operator[](const size_t &pos)
+	{
+		if (pos < size())
+			return *slot(start + pos);
+		else
+			throw index_out_of_bound();
+	}
+	const T &operator[](const size_t &pos) const
+	{
+		if (pos < size())
+			return *slot(start + pos);
+		else
+			throw index_out_of_bound();
+	}
+
+	T &front()
+	{
+		if (!empty())
+			return *slot(start);
+		else
+			throw container_is_empty();
+	}
+	const T &front() const
+	{
+		if (!empty())
+			return *slot(start);
+		else
+			throw container_is_empty();
+	}
+
+	T &back()
+	{
+		if (!empty())
+			return *slot(start + curLength - 1);
+		else
+			throw container_is_empty();
+	}
+	const T &back() const
+	{
+		if (!empty())
+			return *slot(start + curLength - 1);
+		else
+			throw container_is_empty();
+	}
+
+	iterator begin()
+	{
+		return iterator(start, this);
+	}
+	const_iterator begin() const
+	{
+		return cbegin();
+	}
+	const_iterator cbegin() const
+	{
+		return const_iterator(start, this);
+	}
+
+	iterator end()
+	{
+		return iterator(start + curLength, this);
+	}
+	const_iterator end() const
+	{
+		return cend();
+	}
+	const_iterator cend() const
+	{
+		return const_iterator(start + curLength, this);
+	}
+
+	/*
+	 * Segmented iteration as in deque: f(first, last) is called once per contiguous
+	 * run, in order. Every block but the two end ones is a full run of BLOCK_SIZE.
+	 */
+	template <class F>
+	F for_each_segment(F f)
+	{
+		return for_each_segment(begin(), end(), f);
+	}
+	template <class F>
+	F for_each_segment(F f) const
+	{
+		return for_each_segment(cbegin(), cend(), f);
+	}
+	template <class F>
+	F for_each_segment(iterator first, iterator last, F f)
+	{
+		if (first.container != this || last.container != this || first.pos < start || last.pos > start + curLength || last < first)
+			throw invalid_iterator();
+		return visitRuns(first.pos, last.pos, f, (T *)NULL);
+	}
+	template <class F>
+	F for_each_segment(const_iterator first, const_iterator last, F f) const
+	{
+		if (first.container != this || last.container != this || first.pos < start || last.pos > start + curLength || last < first)
+			throw invalid_iterator();
+		return visitRuns(first.pos, last.pos, f, (const T *)NULL);
+	}
+
+	bool empty() const
+	{
+		return curLength == 0;
+	}
+
+	size_t size() const
+	{
+		return curLength;
+	}
+
+	void clear()
+	{
+		while (curLength)
+			pop_back();
+	}
+
+	template <class... Args>
+	iterator emplace(iterator pos, Args &&... args)
+	{
+		if (pos.container != this || pos.pos < start || pos.pos > start + curLength)
+			throw invalid_iterator();
+		size_t p = pos.pos - start;
+		if (p == curLength)
+		{
+			emplace_back(std::forward<Args>(args)...);
+			return iterator(start + p, this);
+		}
+		T tmp(std::forward<Args>(args)...); //args may refer to an element that is about to be shifted
+		if (p < curLength / 2)
+		{
+			growFront();
+			--start;
+			for (size_t i = 0; i < p; ++i)
+				relocate(slot(start + i), slot(start + i + 1));
+		}
+		else
+		{
+			growBack();
+			for (size_t i = curLength; i > p; --i)
+				relocate(slot(start + i), slot(start + i - 1));
+		}
+		new (slot(start + p)) T(std::move(tmp));
+		++curLength;
+		return iterator(start + p, this);
+	}
+	iterator insert(iterator pos, const T &value)
+	{
+		return emplace(pos, value);
+	}
+	iterator insert(iterator pos, T &&value)
+	{
+		return emplace(pos, std::move(value));
+	}
+	template <class InputIt>
+	typename std::enable_if<!std::is_integral<InputIt>::value, iterator>::type insert(iterator pos, InputIt first, InputIt last)
+	{
+		if (pos.container != this || pos.pos < start || pos.pos > start + curLength)
+			throw invalid_iterator();
+		return insertRange(pos.pos - start, first, last);
+	}
+	iterator insert(iterator pos, size_t n, const T &value)
+	{
+		if (pos.container != this || pos.pos < start || pos.pos > start + curLength)
+			throw invalid_iterator();
+		T tmp(value); //value may be one of the elements that get moved
+		return insertRange(pos.pos - start, fill_iterator(&tmp, n), fill_iterator(&tmp, 0));
+	}
+	template <class InputIt>
+	typename std::enable_if<!std::is_integral<InputIt>::value>::type assign(InputIt first, InputIt last)
+	{
+		clear();
+		for (; first != last; ++first)
+			emplace_back(*first);
+	}
+	void assign(size_t n, const T &value)
+	{
+		T tmp(value);
+		clear();
+		for (size_t i = 0; i < n; ++i)
+			push_back(tmp);
+	}
+	void append(const T *data, size_t n) //bulk push_back of a contiguous array
+	{
+		for (size_t i = 0; i < n; ++i)
+			push_back(data[i]);
+	}
+	iterator erase(iterator pos)
+	{
+		if (curLength == 0 || pos == end() || pos.container != this || pos.pos < start)
+			throw invalid_iterator();
+		size_t p = pos.pos - start;
+		slot(start + p)->~T();
+		--curLength;
+		if (p < curLength / 2)
+		{
+			for (size_t i = p; i > 0; --i)
+				relocate(slot(start + i), slot(start + i - 1));
+			++start;
+			shrinkFront();
+		}
+		else
+		{
+			for (size_t i = p; i < curLength; ++i)
+				relocate(slot(start + i), slot(start + i + 1));
+			shrinkBack();
+		}
+		return iterator(start + p, this);
+	}
+	/*
+	 * The gap left by [first, last) is closed from the shorter side, so at most
+	 * min(first - begin(), end() - last) elements move.
+	 */
+	iterator erase(iterator first, iterator last)
+	{
+		if (first.container != this || last.container != this || first.pos < start || last.pos > start + curLength || last < first)
+			throw invalid_iterator();
+		size_t p = first.pos - start, k = last.pos - first.pos;
+		if (k == 0)
+			return last;
+		for (size_t i = first.pos; i < last.pos; ++i)
+			slot(i)->~T();
+		size_t oldStart = start, oldEnd = start + curLength;
+		curLength -= k;
+		if (p < curLength - p)
+		{
+			for (size_t i = p; i > 0; --i)
+				relocate(slot(start + i - 1 + k), slot(start + i - 1));
+			start += k;
+			dropBlocks(oldStart, start);
+		}
+		else
+		{
+			for (size_t i = p; i < curLength; ++i)
+				relocate(slot(start + i), slot(start + i + k));
+			dropBlocks(start + curLength, oldEnd);
+		}
+		return iterator(start + p, this);
+	}
+
+	template <class... Args>
+	void emplace_back(Args &&... args)
+	{
+		growBack();
+		new (slot(start + curLength)) T(std::forward<Args>(args)...);
+		++curLength;
+	}
+	void push_back(const T &value)
+	{
+		emplace_back(value);
+	}
+	void push_back(T &&value)
+	{
+		emplace_back(std::move(value));
+	}
+
+	void pop_back()
+	{
+		if (!empty())
+		{
+			--curLength;
+			slot(start + curLength)->~T();
+			shrinkBack();
+		}
+		else
+			throw container_is_empty();
+	}
+
+	void pop_back_n(size_t n) //drop the last n elements
+	{
+		if (n > curLength)
+			throw container_is_empty();
+		size_t oldEnd = start + curLength;
+		for (size_t i = oldEnd - n; i < oldEnd; ++i)
+			slot(i)->~T();
+		curLength -= n;
+		if (n)
+			dropBlocks(start + curLength, oldEnd);
+	}
+
+	template <class... Args>
+	void emplace_front(Args &&... args)
+	{
+		growFront();
+		new (slot(start - 1)) T(std::forward<Args>(args)...);
+		--start;
+		++curLength;
+	}
+	void push_front(const T &value)
+	{
+		emplace_front(value);
+	}
+	void push_front(T &&value)
+	{
+		emplace_front(std::move(value));
+	}
+
+	void pop_front()
+	{
+		if (!empty())
+		{
+			slot(start)->~T();
+			++start;
+			--curLength;
+			shrinkFront();
+		}
+		else
+			throw container_is_empty();
+	}
+	void pop_front_n(size_t n) //drop the first n elements
+	{
+		if (n > curLength)
+			throw container_is_empty();
+		size_t oldStart = start;
+		for (size_t i = start; i < start + n; ++i)
+			slot(i)->~T();
+		start += n;
+		curLength -= n;
+		if (n)
+			dropBlocks(oldStart, start);
+	}
+};
+template <class T>
+constexpr size_t fixed_deque<T>::BLOCK_SIZE;
+
+template <class T>
+void swap(fixed_deque<T> &lhs, fixed_deque<T> &rhs) noexcept
+{
+	lhs.swap(rhs);
+}
+
+} // namespace sjtu
+
+#endif
@@ -0,0 +1,355 @@
+#ifndef SJTU_MAPPED_DEQUE_HPP
+#define SJTU_MAPPED_DEQUE_HPP
+
+#include "deque.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace sjtu
+{
+/*
+ * A deque whose blocks live in a memory-mapped file, so its contents survive the
+ * process. The file holds a header followed by blocks laid out like deque::Node, a
+ * ring buffer of deque_block_size<T> elements, linked by file offsets instead of
+ * pointers. Opening an existing file only maps it and checks its header: nothing
+ * else is read or rebuilt.
+ * Every operation works on the mapping in place and the kernel writes it back
+ * lazily; sync() forces it to disk. Emptied blocks go to a free list in the file
+ * and the file grows by doubling. T must be trivially copyable, since its bytes are
+ * all that is stored, and the file is only portable between builds that agree on
+ * sizeof(T) and the block size. POSIX only.
+ */
+template <class T>
+class mapped_deque
+{
+	static_assert(std::is_trivially_copyable<T>::value, "mapped_deque stores raw bytes and needs trivially copyable elements");
+	static_assert(alignof(T) <= CACHE_LINE_BYTES, "blocks in the file are only cache-line aligned");
+	static const size_t BlockSize = deque_block_size<T>::value;
+	typedef uint64_t offset_t; //position in the file, 0 stands for NULL since the header lives there
+
+	struct Header
+	{
+		char magic[8];
+		uint64_t elemSize;
+		uint64_t blockSize;
+		uint64_t length;
+		offset_t head; //first block
+		offset_t tail; //last block
+		offset_t freeList; //emptied blocks, linked through next
+		uint64_t used; //bytes of the file handed out so far
+	};
+	struct Block //the file image of deque::Node
+	{
+		offset_t prev;
+		offset_t next;
+		uint64_t first;
+		uint64_t blockSize;
+		alignas(T) unsigned char storage[sizeof(T) * BlockSize];
+		T *slot(size_t i)
+		{
+			i += first;
+			if (i >= BlockSize)
+				i -= BlockSize;
+			return reinterpret_cast<T *>(storage) + i;
+		}
+	};
+
+	static const size_t HeaderBytes = (sizeof(Header) + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES * CACHE_LINE_BYTES;
+	static const size_t BlockBytes = (sizeof(Block) + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES * CACHE_LINE_BYTES;
+	static const size_t InitialBlocks = 4;
+
+	int fd;
+	char *base;
+	size_t mapped;
+
+	static const char *magicWord()
+	{
+		return "SJTUDEQ1";
+	}
+	Header *header() const
+	{
+		return reinterpret_cast<Header *>(base);
+	}
+	Block *block(offset_t o) const
+	{
+		return o ? reinterpret_cast<Block *>(base + o) : NULL;
+	}
+	void map(size_t bytes)
+	{
+		void *p = ::mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED)
+			throw runtime_error();
+		base = static_cast<char *>(p);
+		mapped = bytes;
+	}
+	void grow(size_t bytes) //pointers into the mapping are invalidated, offsets stay valid; on failure the old mapping stays
+	{
+		if (::ftruncate(fd, off_t(bytes)) != 0)
+			throw runtime_error();
+		char *old = base;
+		size_t oldBytes = mapped;
+		map(bytes); //the new mapping comes first, so a failure leaves base as it was
+		::munmap(old, oldBytes);
+	}
+	bool validHeader() const //the header of a file we did not create, before any offset in it is followed
+	{
+		Header *h = header();
+		if (std::memcmp(h->magic, magicWord(), sizeof(h->magic)) != 0 || h->elemSize != sizeof(T) || h->blockSize != BlockSize)
+			return false;
+		if (h->used < HeaderBytes || h->used > mapped || (h->used - HeaderBytes) % BlockBytes != 0)
+			return false;
+		return validBlock(h->head) && validBlock(h->tail) && validBlock(h->freeList) && (h->head == 0) == (h->tail == 0) && (h->head != 0 || h->length == 0);
+	}
+	bool validBlock(offset_t o) const //0 or the start of a block already handed out
+	{
+		return o == 0 || (o >= HeaderBytes && o < header()->used && (o - HeaderBytes) % BlockBytes == 0);
+	}
+	offset_t newBlock()
+	{
+		Header *h = header();
+		offset_t o = h->freeList;
+		if (o)
+			h->freeList = block(o)->next;
+		else
+		{
+			if (h->used + BlockBytes > mapped)
+				grow(mapped * 2 > h->used + BlockBytes ? mapped * 2 : h->used + BlockBytes);
+			h = header();
+			o = h->used;
+			h->used += BlockBytes;
+		}
+		Block *b = block(o);
+		b->prev = b->next = 0;
+		b->first = b->blockSize = 0;
+		return o;
+	}
+	void deleteBlock(offset_t o) //unlink an empty block and put it on the free list
+	{
+		Header *h = header();
+		Block *b = block(o);
+		if (b->prev)
+			block(b->prev)->next = b->next;
+		else
+			h->head = b->next;
+		if (b->next)
+			block(b->next)->prev = b->prev;
+		else
+			h->tail = b->prev;
+		b->next = h->freeList;
+		h->freeList = o;
+	}
+	Block *findBlock(size_t pos, size_t &offset) const //walks the blocks from the nearer end
+	{
+		Header *h = header();
+		if (pos < h->length / 2)
+		{
+			Block *b = block(h->head);
+			for (; pos >= b->blockSize; b = block(b->next))
+				pos -= b->blockSize;
+			offset = pos;
+			return b;
+		}
+		size_t back = h->length - pos;
+		Block *b = block(h->tail);
+		for (; back > b->blockSize; b = block(b->prev))
+			back -= b->blockSize;
+		offset = b->blockSize - back;
+		return b;
+	}
+
+  public:
+	explicit mapped_deque(const char *path) : fd(-1), base(NULL), mapped(0)
+	{
+		fd = ::open(path, O_RDWR | O_CREAT, 0644);
+		if (fd < 0)
+			throw runtime_error();
+		struct stat st;
+		if (::fstat(fd, &st) != 0)
+		{
+			::close(fd);
+			throw runtime_error();
+		}
+		try
+		{
+			if (st.st_size == 0) //a new file
+			{
+				size_t bytes = HeaderBytes + InitialBlocks * BlockBytes;
+				if (::ftruncate(fd, off_t(bytes)) != 0)
+					throw runtime_error();
+				map(bytes);
+				Header *h = header();
+				std::memcpy(h->magic, magicWord(), sizeof(h->magic));
+				h->elemSize = sizeof(T);
+				h->blockSize = BlockSize;
+				h->length = 0;
+				h->head = h->tail = h->freeList = 0;
+				h->used = HeaderBytes;
+			}
+			else
+			{
+				if (size_t(st.st_size) < HeaderBytes)
+					throw runtime_error();
+				map(size_t(st.st_size));
+				if (!validHeader())
+					throw runtime_error();
+			}
+		}
+		catch (...)
+		{
+			if (base)
+				::munmap(base, mapped);
+			::close(fd);
+			throw;
+		}
+	}
+	mapped_deque(const mapped_deque &) = delete;
+	mapped_deque &operator=(const mapped_deque &) = delete;
+	~mapped_deque() //dirty pages still reach the file, only not before sync() would have
+	{
+		::munmap(base, mapped);
+		::close(fd);
+	}
+
+	void sync() //blocks until the contents are on disk
+	{
+		if (::msync(base, mapped, MS_SYNC) != 0)
+			throw runtime_error();
+	}
+
+	size_t size() const
+	{
+		return header()->length;
+	}
+	bool empty() const
+	{
+		return header()->length == 0;
+	}
+	void clear()
+	{
+		while (header()->head)
+			deleteBlock(header()->head);
+		header()->length = 0;
+	}
+
+	T &at(const size_t &pos) //O(size() / block size), the file keeps no block index
+	{
+		if (pos >= size())
+			throw index_out_of_bound();
+		size_t offset;
+		return *findBlock(pos, offset)->slot(offset);
+	}
+	const T &at(const size_t &pos) const
+	{
+		return const_cast<mapped_deque *>(this)->at(pos);
+	}
+	T &operator[](const size_t &pos)
+	{
+		return at(pos);
+	}
+	const T &operator[](const size_t &pos) const
+	{
+		return at(pos);
+	}
+	T &front()
+	{
+		if (empty())
+			throw container_is_empty();
+		return *block(header()->head)->slot(0);
+	}
+	T &back()
+	{
+		if (empty())
+			throw container_is_empty();
+		Block *b = block(header()->tail);
+		return *b->slot(b->blockSize - 1);
+	}
+
+	void push_back(const T &value)
+	{
+		T tmp(value); //value may live in the mapping, which a new block can move
+		Header *h = header();
+		Block *b = block(h->tail);
+		if (b == NULL || b->blockSize == BlockSize)
+		{
+			offset_t o = newBlock();
+			h = header();
+			block(o)->prev = h->tail;
+			if (h->tail)
+				block(h->tail)->next = o;
+			else
+				h->head = o;
+			h->tail = o;
+			b = block(o);
+		}
+		new (b->slot(b->blockSize)) T(tmp);
+		++b->blockSize;
+		++h->length;
+	}
+	void push_front(const T &value)
+	{
+		T tmp(value);
+		Header *h = header();
+		Block *b = block(h->head);
+		if (b == NULL || b->blockSize == BlockSize)
+		{
+			offset_t o = newBlock();
+			h = header();
+			block(o)->next = h->head;
+			if (h->head)
+				block(h->head)->prev = o;
+			else
+				h->tail = o;
+			h->head = o;
+			b = block(o);
+		}
+		b->first = b->first ? b->first - 1 : BlockSize - 1;
+		++b->blockSize;
+		new (b->slot(0)) T(tmp);
+		++h->length;
+	}
+	void pop_front()
+	{
+		if (empty())
+			throw container_is_empty();
+		Header *h = header();
+		Block *b = block(h->head);
+		b->first = b->first + 1 == BlockSize ? 0 : b->first + 1;
+		--h->length;
+		if (--b->blockSize == 0)
+			deleteBlock(h->head);
+	}
+	void pop_back()
+	{
+		if (empty())
+			throw container_is_empty();
+		Header *h = header();
+		Block *b = block(h->tail);
+		--h->length;
+		if (--b->blockSize == 0)
+			deleteBlock(h->tail);
+	}
+
+	template <class F>
+	F for_each_segment(F f) //f(first, last) on each contiguous run in order, as deque::for_each_segment
+	{
+		for (Block *b = block(header()->head); b; b = block(b->next))
+		{
+			size_t k = BlockSize - b->first < b->blockSize ? BlockSize - b->first : b->blockSize;
+			f(b->slot(0), b->slot(0) + k);
+			if (k < b->blockSize)
+				f(b->slot(k), b->slot(k) + (b->blockSize - k));
+		}
+		return f;
+	}
+};
+
+} // namespace sjtu
+
+#endif
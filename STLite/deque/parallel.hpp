@@ -0,0 +1,262 @@
+#ifndef SJTU_PARALLEL_HPP
+#define SJTU_PARALLEL_HPP
+
+#include "deque.hpp"
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace sjtu
+{
+const size_t PARALLEL_MIN_ELEMENTS = 1 << 15; //smaller deques are processed on the calling thread
+
+/*
+ * A fixed set of worker threads that runs index loops. run(n, f) calls f(i) for every
+ * i in [0, n): each thread starts on its own contiguous share of the indices and,
+ * once that is used up, steals the upper half of the largest share it can find.
+ * The calling thread takes part as thread 0. Calls made from inside a running loop
+ * are executed serially instead of waiting for the busy pool. Link with -pthread.
+ */
+class thread_pool
+{
+	struct Share
+	{
+		std::mutex lock;
+		size_t lo, hi;
+		Share() : lo(0), hi(0) {}
+	};
+
+	std::vector<std::thread> workers;
+	Share *shares; //one per thread, the caller included
+	size_t threadCount;
+	std::mutex lock; //guards everything below
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(size_t)> *job;
+	size_t generation;
+	size_t active;
+	bool stopping;
+	std::exception_ptr error;
+	std::mutex runLock; //one loop at a time
+
+	static bool &insidePool()
+	{
+		static thread_local bool inside = false;
+		return inside;
+	}
+	bool takeOwn(size_t id, size_t &i)
+	{
+		std::lock_guard<std::mutex> guard(shares[id].lock);
+		if (shares[id].lo == shares[id].hi)
+			return false;
+		i = shares[id].lo++;
+		return true;
+	}
+	bool steal(size_t id) //move half of the largest remaining share over to id
+	{
+		size_t victim = id, most = 0;
+		for (size_t k = 1; k < threadCount; ++k)
+		{
+			size_t v = (id + k) % threadCount;
+			std::lock_guard<std::mutex> guard(shares[v].lock);
+			if (shares[v].hi - shares[v].lo > most)
+			{
+				most = shares[v].hi - shares[v].lo;
+				victim = v;
+			}
+		}
+		if (most == 0)
+			return false;
+		size_t lo, hi;
+		{
+			std::lock_guard<std::mutex> guard(shares[victim].lock);
+			if (shares[victim].lo == shares[victim].hi)
+				return true; //someone else got there first, look again
+			hi = shares[victim].hi;
+			lo = shares[victim].lo + (hi - shares[victim].lo) / 2;
+			shares[victim].hi = lo;
+		}
+		std::lock_guard<std::mutex> guard(shares[id].lock);
+		shares[id].lo = lo;
+		shares[id].hi = hi;
+		return true;
+	}
+	void participate(size_t id)
+	{
+		const std::function<void(size_t)> &f = *job;
+		size_t i;
+		try
+		{
+			for (;;)
+			{
+				if (takeOwn(id, i))
+					f(i);
+				else if (!steal(id))
+					break;
+			}
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (!error)
+				error = std::current_exception();
+			for (size_t k = 0; k < threadCount; ++k) //drop the remaining work
+			{
+				std::lock_guard<std::mutex> g(shares[k].lock);
+				shares[k].lo = shares[k].hi;
+			}
+		}
+	}
+	void workerLoop(size_t id)
+	{
+		insidePool() = true;
+		size_t seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				wake.wait(guard, [&] { return stopping || generation != seen; });
+				if (stopping)
+					return;
+				seen = generation;
+			}
+			participate(id);
+			std::lock_guard<std::mutex> guard(lock);
+			if (--active == 0)
+				done.notify_one();
+		}
+	}
+
+  public:
+	explicit thread_pool(size_t n = std::thread::hardware_concurrency()) : shares(NULL), threadCount(n ? n : 1), job(NULL), generation(0), active(0), stopping(false)
+	{
+		shares = new Share[threadCount];
+		for (size_t id = 1; id < threadCount; ++id)
+			workers.push_back(std::thread(&thread_pool::workerLoop, this, id));
+	}
+	thread_pool(const thread_pool &) = delete;
+	thread_pool &operator=(const thread_pool &) = delete;
+	~thread_pool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (size_t k = 0; k < workers.size(); ++k)
+			workers[k].join();
+		delete[] shares;
+	}
+
+	size_t size() const
+	{
+		return threadCount;
+	}
+	void run(size_t n, const std::function<void(size_t)> &f)
+	{
+		if (threadCount == 1 || n < 2 || insidePool())
+		{
+			for (size_t i = 0; i < n; ++i)
+				f(i);
+			return;
+		}
+		std::lock_guard<std::mutex> serial(runLock);
+		for (size_t id = 0; id < threadCount; ++id)
+		{
+			std::lock_guard<std::mutex> guard(shares[id].lock);
+			shares[id].lo = n * id / threadCount;
+			shares[id].hi = n * (id + 1) / threadCount;
+		}
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			job = &f;
+			error = std::exception_ptr();
+			active = workers.size();
+			++generation;
+		}
+		wake.notify_all();
+		insidePool() = true;
+		participate(0);
+		insidePool() = false;
+		std::unique_lock<std::mutex> guard(lock);
+		done.wait(guard, [&] { return active == 0; });
+		job = NULL;
+		if (error)
+			std::rethrow_exception(error);
+	}
+};
+
+inline thread_pool &default_thread_pool() //shared by the parallel algorithms unless one is passed in
+{
+	static thread_pool pool;
+	return pool;
+}
+
+/*
+ * Parallel algorithms over a deque. The unit of work is one contiguous run of a
+ * block, so the inner loops walk plain pointers. parallel_reduce folds each run
+ * from its first element and then combines the partial results from left to right
+ * on the calling thread, so for an associative op the result does not depend on the
+ * number of threads or on the schedule.
+ */
+template <class T, size_t BlockSize, class F>
+void parallel_for_each(deque<T, BlockSize> &d, F f, thread_pool &pool = default_thread_pool())
+{
+	if (d.size() < PARALLEL_MIN_ELEMENTS)
+	{
+		d.for_each_segment([&](T *first, T *last) {
+			for (; first != last; ++first)
+				f(*first);
+		});
+		return;
+	}
+	std::vector<std::pair<T *, T *> > runs;
+	d.for_each_segment([&](T *first, T *last) { runs.push_back(std::make_pair(first, last)); });
+	pool.run(runs.size(), [&](size_t i) {
+		for (T *p = runs[i].first; p != runs[i].second; ++p)
+			f(*p);
+	});
+}
+
+template <class T, size_t BlockSize, class F>
+void parallel_transform(deque<T, BlockSize> &d, F f, thread_pool &pool = default_thread_pool()) //x = f(x) for every element
+{
+	parallel_for_each(d, [&](T &x) { x = f(x); }, pool);
+}
+
+template <class T, size_t BlockSize, class Op>
+T parallel_reduce(const deque<T, BlockSize> &d, T init, Op op, thread_pool &pool = default_thread_pool())
+{
+	if (d.size() < PARALLEL_MIN_ELEMENTS)
+	{
+		d.for_each_segment([&](const T *first, const T *last) {
+			for (; first != last; ++first)
+				init = op(init, *first);
+		});
+		return init;
+	}
+	std::vector<std::pair<const T *, const T *> > runs;
+	d.for_each_segment([&](const T *first, const T *last) { runs.push_back(std::make_pair(first, last)); });
+	std::vector<T> partial;
+	partial.reserve(runs.size());
+	for (size_t i = 0; i < runs.size(); ++i)
+		partial.push_back(*runs[i].first);
+	pool.run(runs.size(), [&](size_t i) {
+		T acc = partial[i];
+		for (const T *p = runs[i].first + 1; p != runs[i].second; ++p)
+			acc = op(acc, *p);
+		partial[i] = acc;
+	});
+	for (size_t i = 0; i < partial.size(); ++i)
+		init = op(init, partial[i]);
+	return init;
+}
+
+} // namespace sjtu
+
+#endif
@@ -0,0 +1,386 @@
+#ifndef SJTU_SIMD_HPP
+#define SJTU_SIMD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SJTU_SIMD_X86
+#endif
+
+namespace sjtu
+{
+/*
+ * Scanning kernels over one contiguous run [first, last), used by the deque on each
+ * block. The templates are plain loops for any arithmetic type; int32_t and float
+ * have SSE2 versions and AVX2 versions that are chosen at run time when the CPU has
+ * them. Signed integer sums wrap around on overflow in every version: the plain loops
+ * add in the unsigned type of the same width, as the vector lanes do, rather than
+ * overflowing, which would be undefined. Float sums are added in a different order
+ * than a left-to-right loop. min and
+ * max fold a run into a seed exactly as the plain loop does, so a NaN is skipped
+ * unless it is the seed: every lane starts from the seed and takes x only when x < acc,
+ * which is what _mm_min_ps(x, acc) computes. Only the choice between 0.0 and -0.0 may
+ * differ from the loop. The bit helpers at the end serve the packed deque<bool>.
+ */
+namespace simd
+{
+template <class T>
+const T *find(const T *first, const T *last, const T &value)
+{
+	for (; first != last; ++first)
+		if (*first == value)
+			break;
+	return first;
+}
+template <class T>
+size_t count(const T *first, const T *last, const T &value)
+{
+	size_t res = 0;
+	for (; first != last; ++first)
+		res += *first == value;
+	return res;
+}
+template <class T, bool Wraps = std::is_integral<T>::value && std::is_signed<T>::value>
+struct sum_type //what sums of T are accumulated in
+{
+	typedef T type;
+};
+template <class T>
+struct sum_type<T, true>
+{
+	typedef typename std::make_unsigned<T>::type type;
+};
+template <class T>
+T sum(const T *first, const T *last)
+{
+	typedef typename sum_type<T>::type acc_t;
+	acc_t res = acc_t();
+	for (; first != last; ++first)
+		res += acc_t(*first);
+	return T(res);
+}
+template <class T>
+T min(const T *first, const T *last, T res) //folds the run into res
+{
+	for (; first != last; ++first)
+		if (*first < res)
+			res = *first;
+	return res;
+}
+template <class T>
+T max(const T *first, const T *last, T res)
+{
+	for (; first != last; ++first)
+		if (res < *first)
+			res = *first;
+	return res;
+}
+
+#if defined(SJTU_SIMD_X86) && defined(__SSE2__)
+inline bool hasAvx2()
+{
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+
+__attribute__((target("avx2"))) inline const int32_t *findAvx2(const int32_t *first, const int32_t *last, int32_t value)
+{
+	__m256i v = _mm256_set1_epi32(value);
+	for (; last - first >= 8; first += 8)
+	{
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+		int m = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(x, v)));
+		if (m)
+			return first + __builtin_ctz(m);
+	}
+	return find<int32_t>(first, last, value);
+}
+__attribute__((target("avx2"))) inline size_t countAvx2(const int32_t *first, const int32_t *last, int32_t value)
+{
+	__m256i v = _mm256_set1_epi32(value);
+	size_t res = 0;
+	for (; last - first >= 8; first += 8)
+	{
+		__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first));
+		res += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(x, v))));
+	}
+	return res + count<int32_t>(first, last, value);
+}
+__attribute__((target("avx2"))) inline int32_t sumAvx2(const int32_t *first, const int32_t *last)
+{
+	__m256i acc = _mm256_setzero_si256();
+	for (; last - first >= 8; first += 8)
+		acc = _mm256_add_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first)));
+	uint32_t lanes[8], res = 0;
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+	for (int i = 0; i < 8; ++i)
+		res += lanes[i];
+	for (; first != last; ++first)
+		res += uint32_t(*first);
+	return int32_t(res);
+}
+__attribute__((target("avx2"))) inline int32_t minAvx2(const int32_t *first, const int32_t *last, int32_t res)
+{
+	if (last - first < 8)
+		return min<int32_t>(first, last, res);
+	__m256i acc = _mm256_set1_epi32(res);
+	for (; last - first >= 8; first += 8)
+		acc = _mm256_min_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first)));
+	int32_t lanes[8];
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+	return min<int32_t>(first, last, min<int32_t>(lanes + 1, lanes + 8, lanes[0]));
+}
+__attribute__((target("avx2"))) inline int32_t maxAvx2(const int32_t *first, const int32_t *last, int32_t res)
+{
+	if (last - first < 8)
+		return max<int32_t>(first, last, res);
+	__m256i acc = _mm256_set1_epi32(res);
+	for (; last - first >= 8; first += 8)
+		acc = _mm256_max_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first)));
+	int32_t lanes[8];
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+	return max<int32_t>(first, last, max<int32_t>(lanes + 1, lanes + 8, lanes[0]));
+}
+
+__attribute__((target("avx2"))) inline const float *findAvx2(const float *first, const float *last, float value)
+{
+	__m256 v = _mm256_set1_ps(value);
+	for (; last - first >= 8; first += 8)
+	{
+		int m = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(first), v, _CMP_EQ_OQ));
+		if (m)
+			return first + __builtin_ctz(m);
+	}
+	return find<float>(first, last, value);
+}
+__attribute__((target("avx2"))) inline size_t countAvx2(const float *first, const float *last, float value)
+{
+	__m256 v = _mm256_set1_ps(value);
+	size_t res = 0;
+	for (; last - first >= 8; first += 8)
+		res += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(first), v, _CMP_EQ_OQ)));
+	return res + count<float>(first, last, value);
+}
+__attribute__((target("avx2"))) inline float sumAvx2(const float *first, const float *last)
+{
+	__m256 acc = _mm256_setzero_ps();
+	for (; last - first >= 8; first += 8)
+		acc = _mm256_add_ps(acc, _mm256_loadu_ps(first));
+	float lanes[8];
+	_mm256_storeu_ps(lanes, acc);
+	return sum<float>(lanes, lanes + 8) + sum<float>(first, last);
+}
+__attribute__((target("avx2"))) inline float minAvx2(const float *first, const float *last, float res)
+{
+	if (last - first < 8)
+		return min<float>(first, last, res);
+	__m256 acc = _mm256_set1_ps(res);
+	for (; last - first >= 8; first += 8)
+		acc = _mm256_min_ps(_mm256_loadu_ps(first), acc); //x < acc ? x : acc, a NaN x never gets in
+	float lanes[8];
+	_mm256_storeu_ps(lanes, acc);
+	return min<float>(first, last, min<float>(lanes + 1, lanes + 8, lanes[0]));
+}
+__attribute__((target("avx2"))) inline float maxAvx2(const float *first, const float *last, float res)
+{
+	if (last - first < 8)
+		return max<float>(first, last, res);
+	__m256 acc = _mm256_set1_ps(res);
+	for (; last - first >= 8; first += 8)
+		acc = _mm256_max_ps(_mm256_loadu_ps(first), acc); //x > acc ? x : acc, a NaN x never gets in
+	float lanes[8];
+	_mm256_storeu_ps(lanes, acc);
+	return max<float>(first, last, max<float>(lanes + 1, lanes + 8, lanes[0]));
+}
+
+inline const int32_t *find(const int32_t *first, const int32_t *last, const int32_t &value)
+{
+	if (hasAvx2())
+		return findAvx2(first, last, value);
+	__m128i v = _mm_set1_epi32(value);
+	for (; last - first >= 4; first += 4)
+	{
+		int m = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(first)), v)));
+		if (m)
+			return first + __builtin_ctz(m);
+	}
+	return find<int32_t>(first, last, value);
+}
+inline size_t count(const int32_t *first, const int32_t *last, const int32_t &value)
+{
+	if (hasAvx2())
+		return countAvx2(first, last, value);
+	__m128i v = _mm_set1_epi32(value);
+	size_t res = 0;
+	for (; last - first >= 4; first += 4)
+		res += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(first)), v))));
+	return res + count<int32_t>(first, last, value);
+}
+inline int32_t sum(const int32_t *first, const int32_t *last) //wraps around on overflow
+{
+	if (hasAvx2())
+		return sumAvx2(first, last);
+	__m128i acc = _mm_setzero_si128();
+	for (; last - first >= 4; first += 4)
+		acc = _mm_add_epi32(acc, _mm_loadu_si128(reinterpret_cast<const __m128i *>(first)));
+	uint32_t lanes[4], res = 0;
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+	for (int i = 0; i < 4; ++i)
+		res += lanes[i];
+	for (; first != last; ++first)
+		res += uint32_t(*first);
+	return int32_t(res);
+}
+inline __m128i selectEpi32(__m128i mask, __m128i a, __m128i b) //SSE2 has no 32-bit min/max, blend by a compare mask
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+inline int32_t min(const int32_t *first, const int32_t *last, int32_t res)
+{
+	if (hasAvx2())
+		return minAvx2(first, last, res);
+	if (last - first < 4)
+		return min<int32_t>(first, last, res);
+	__m128i acc = _mm_set1_epi32(res);
+	for (; last - first >= 4; first += 4)
+	{
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+		acc = selectEpi32(_mm_cmplt_epi32(x, acc), x, acc);
+	}
+	int32_t lanes[4];
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+	return min<int32_t>(first, last, min<int32_t>(lanes + 1, lanes + 4, lanes[0]));
+}
+inline int32_t max(const int32_t *first, const int32_t *last, int32_t res)
+{
+	if (hasAvx2())
+		return maxAvx2(first, last, res);
+	if (last - first < 4)
+		return max<int32_t>(first, last, res);
+	__m128i acc = _mm_set1_epi32(res);
+	for (; last - first >= 4; first += 4)
+	{
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first));
+		acc = selectEpi32(_mm_cmpgt_epi32(x, acc), x, acc);
+	}
+	int32_t lanes[4];
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+	return max<int32_t>(first, last, max<int32_t>(lanes + 1, lanes + 4, lanes[0]));
+}
+
+inline const float *find(const float *first, const float *last, const float &value)
+{
+	if (hasAvx2())
+		return findAvx2(first, last, value);
+	__m128 v = _mm_set1_ps(value);
+	for (; last - first >= 4; first += 4)
+	{
+		int m = _mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(first), v));
+		if (m)
+			return first + __builtin_ctz(m);
+	}
+	return find<float>(first, last, value);
+}
+inline size_t count(const float *first, const float *last, const float &value)
+{
+	if (hasAvx2())
+		return countAvx2(first, last, value);
+	__m128 v = _mm_set1_ps(value);
+	size_t res = 0;
+	for (; last - first >= 4; first += 4)
+		res += __builtin_popcount(_mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(first), v)));
+	return res + count<float>(first, last, value);
+}
+inline float sum(const float *first, const float *last)
+{
+	if (hasAvx2())
+		return sumAvx2(first, last);
+	__m128 acc = _mm_setzero_ps();
+	for (; last - first >= 4; first += 4)
+		acc = _mm_add_ps(acc, _mm_loadu_ps(first));
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc);
+	return sum<float>(lanes, lanes + 4) + sum<float>(first, last);
+}
+inline float min(const float *first, const float *last, float res)
+{
+	if (hasAvx2())
+		return minAvx2(first, last, res);
+	if (last - first < 4)
+		return min<float>(first, last, res);
+	__m128 acc = _mm_set1_ps(res);
+	for (; last - first >= 4; first += 4)
+		acc = _mm_min_ps(_mm_loadu_ps(first), acc);
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc);
+	return min<float>(first, last, min<float>(lanes + 1, lanes + 4, lanes[0]));
+}
+inline float max(const float *first, const float *last, float res)
+{
+	if (hasAvx2())
+		return maxAvx2(first, last, res);
+	if (last - first < 4)
+		return max<float>(first, last, res);
+	__m128 acc = _mm_set1_ps(res);
+	for (; last - first >= 4; first += 4)
+		acc = _mm_max_ps(_mm_loadu_ps(first), acc);
+	float lanes[4];
+	_mm_storeu_ps(lanes, acc);
+	return max<float>(first, last, max<float>(lanes + 1, lanes + 4, lanes[0]));
+}
+#endif
+
+inline size_t popcount(uint64_t x)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(x);
+#else
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return size_t((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+inline size_t ctz(uint64_t x) //x must not be 0
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(x);
+#else
+	size_t n = 0;
+	for (; !(x & 1); x >>= 1)
+		++n;
+	return n;
+#endif
+}
+
+#if defined(SJTU_SIMD_X86)
+inline bool hasPopcnt()
+{
+	static const bool popcnt = __builtin_cpu_supports("popcnt");
+	return popcnt;
+}
+__attribute__((target("popcnt"))) inline size_t popcountPopcnt(const uint64_t *first, const uint64_t *last)
+{
+	size_t res = 0;
+	for (; first != last; ++first)
+		res += __builtin_popcountll(*first);
+	return res;
+}
+#endif
+inline size_t popcount(const uint64_t *first, const uint64_t *last) //set bits in a run of words
+{
+#if defined(SJTU_SIMD_X86)
+	if (hasPopcnt())
+		return popcountPopcnt(first, last);
+#endif
+	size_t res = 0;
+	for (; first != last; ++first)
+		res += popcount(*first);
+	return res;
+}
+} // namespace simd
+} // namespace sjtu
+
+#endif
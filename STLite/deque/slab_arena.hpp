@@ -0,0 +1,168 @@
+#ifndef SJTU_SLAB_ARENA_HPP
+#define SJTU_SLAB_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace sjtu
+{
+const size_t HUGE_PAGE_BYTES = size_t(2) << 20; //a transparent huge page with 4K base pages
+
+struct slab_stats
+{
+	size_t slabs; //slabs mapped, they are never unmapped
+	size_t blocks; //blocks carved out of them so far
+	size_t liveBlocks; //blocks currently in use
+	size_t advisedBlocks; //carved blocks whose slab the kernel accepted MADV_HUGEPAGE for
+	size_t hugeBlocks; //carved blocks backed by huge pages, estimated from /proc/self/smaps
+};
+
+/*
+ * Source of deque blocks of Bytes bytes for the huge-page mode, shared by every deque
+ * with that block size. Memory comes in slabs aligned to a huge page and advised with
+ * MADV_HUGEPAGE, so that the kernel can back them with transparent huge pages and a
+ * scan needs one TLB entry per 2M instead of one per 4K. Blocks are carved at
+ * strides of Align bytes; freed blocks are reused, slabs are kept for the life of the
+ * process. Deques on different threads share the arena, hence the lock.
+ */
+template <size_t Bytes, size_t Align>
+class slab_arena
+{
+	static const size_t Stride = (Bytes + Align - 1) / Align * Align;
+	static const size_t SlabBytes = (Stride + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+
+	struct Slab
+	{
+		char *base;
+		size_t carved;
+		bool advised;
+		Slab *next;
+	};
+	struct FreeBlock
+	{
+		FreeBlock *next;
+	};
+
+	std::mutex lock;
+	Slab *slabs; //newest first, blocks are carved from the newest
+	FreeBlock *freeList;
+	slab_stats counts; //hugeBlocks is only filled in by stats()
+
+	slab_arena() : slabs(NULL), freeList(NULL), counts() {}
+	static char *alignUp(char *p, size_t a)
+	{
+		return reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(p) + a - 1) & ~uintptr_t(a - 1));
+	}
+	void addSlab()
+	{
+		size_t len = SlabBytes + HUGE_PAGE_BYTES; //room to align the start
+		bool advised = false;
+#if defined(__linux__)
+		void *p = ::mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			throw std::bad_alloc();
+		char *raw = static_cast<char *>(p);
+		char *base = alignUp(raw, HUGE_PAGE_BYTES);
+		if (base != raw)
+			::munmap(raw, base - raw);
+		if (base + SlabBytes != raw + len)
+			::munmap(base + SlabBytes, raw + len - (base + SlabBytes));
+#ifdef MADV_HUGEPAGE
+		advised = ::madvise(base, SlabBytes, MADV_HUGEPAGE) == 0;
+#endif
+#else
+		char *raw = static_cast<char *>(std::malloc(len));
+		if (raw == NULL)
+			throw std::bad_alloc();
+		char *base = alignUp(raw, HUGE_PAGE_BYTES);
+#endif
+		Slab *s = new Slab;
+		s->base = base;
+		s->carved = 0;
+		s->advised = advised;
+		s->next = slabs;
+		slabs = s;
+		++counts.slabs;
+	}
+	size_t hugeBlocks() const //carved blocks of each mapping, weighted by its share of huge pages
+	{
+		double res = 0;
+#if defined(__linux__)
+		FILE *f = std::fopen("/proc/self/smaps", "r");
+		if (f == NULL)
+			return 0;
+		char line[512];
+		size_t carved = 0, size = 0;
+		unsigned long lo, hi, kb;
+		while (std::fgets(line, sizeof(line), f))
+		{
+			if (std::sscanf(line, "%lx-%lx", &lo, &hi) == 2)
+			{
+				carved = 0;
+				size = hi - lo;
+				for (const Slab *s = slabs; s; s = s->next)
+					if (uintptr_t(s->base) >= lo && uintptr_t(s->base) < hi)
+						carved += s->carved;
+			}
+			else if (carved && std::sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+				res += double(carved) * double(kb << 10) / double(size);
+		}
+		std::fclose(f);
+#endif
+		return size_t(res + 0.5);
+	}
+
+  public:
+	static slab_arena &instance() //never destroyed, blocks may still be freed during static destruction
+	{
+		static slab_arena *arena = new slab_arena;
+		return *arena;
+	}
+	void *allocate()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		void *p;
+		if (freeList)
+		{
+			p = freeList;
+			freeList = freeList->next;
+		}
+		else
+		{
+			if (slabs == NULL || (slabs->carved + 1) * Stride > SlabBytes)
+				addSlab();
+			p = slabs->base + Stride * slabs->carved++;
+			++counts.blocks;
+			if (slabs->advised)
+				++counts.advisedBlocks;
+		}
+		++counts.liveBlocks;
+		return p;
+	}
+	void deallocate(void *p)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		FreeBlock *b = static_cast<FreeBlock *>(p);
+		b->next = freeList;
+		freeList = b;
+		--counts.liveBlocks;
+	}
+	slab_stats stats()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		slab_stats res = counts;
+		res.hugeBlocks = hugeBlocks();
+		return res;
+	}
+};
+
+} // namespace sjtu
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef SJTU_SORT_HPP
+#define SJTU_SORT_HPP
+
+#include "deque.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace sjtu
+{
+/*
+ * Sorting a deque in place. The deque is compacted, every contiguous run of a block
+ * is sorted on its own, and the runs are then merged pairwise, level by level, into
+ * a scratch buffer of size() elements and back. Both the run sorts and the merges of
+ * one level are spread over a thread_pool. Iterators into the deque are invalidated.
+ * The buffer is the same extra memory as copying the deque into a vector to sort it.
+ * If comp or a move throws, the buffer is freed and the deque is left holding some
+ * arrangement of valid elements, with none leaked.
+ */
+template <class T, class Compare>
+class run_sorter
+{
+	typedef std::pair<T *, T *> Run;
+
+	struct Cursor //walks the elements of consecutive runs, the last run is a (NULL, NULL) sentinel
+	{
+		const Run *run;
+		T *p;
+		Cursor(const Run *r, T *x) : run(r), p(x) {}
+		T &operator*() const { return *p; }
+		Cursor &operator++()
+		{
+			if (++p == run->second)
+			{
+				++run;
+				p = run->first;
+			}
+			return *this;
+		}
+		bool operator!=(const Cursor &rhs) const { return p != rhs.p; }
+	};
+	struct Construct //counts what it built, for Scratch to destroy
+	{
+		size_t *built;
+		explicit Construct(size_t *b) : built(b) {}
+		void operator()(T &dst, T &src) const
+		{
+			new (&dst) T(std::move(src));
+			++*built;
+		}
+	};
+	struct Assign
+	{
+		void operator()(T &dst, T &src) const { dst = std::move(src); }
+	};
+
+	struct Scratch //the merge buffer; first-pass merge k constructs built[k] elements from from[k] on
+	{
+		T *data;
+		std::vector<size_t> from, built;
+		explicit Scratch(size_t n) : data(static_cast<T *>(::operator new(n * sizeof(T)))) {}
+		Scratch(const Scratch &) = delete;
+		Scratch &operator=(const Scratch &) = delete;
+		~Scratch()
+		{
+			for (size_t k = 0; k < from.size(); ++k)
+				for (size_t i = 0; i < built[k]; ++i)
+					data[from[k] + i].~T();
+			::operator delete(data);
+		}
+	};
+
+	std::vector<Run> runs;
+	std::vector<size_t> starts; //position of the first element of each run, size() at the end
+	size_t total;
+	Compare comp;
+
+	Cursor at(size_t k) const //cursor to the k-th element, the end cursor if k == total
+	{
+		size_t r = std::upper_bound(starts.begin(), starts.end(), k) - starts.begin() - 1;
+		return Cursor(&runs[r], runs[r].first + (k - starts[r]));
+	}
+	template <class In, class Out, class Put>
+	void merge(In a, In aEnd, In b, In bEnd, Out out, Put put) const //stable: ties are taken from a
+	{
+		for (; a != aEnd && b != bEnd; ++out)
+		{
+			if (comp(*b, *a))
+			{
+				put(*out, *b);
+				++b;
+			}
+			else
+			{
+				put(*out, *a);
+				++a;
+			}
+		}
+		for (; a != aEnd; ++a, ++out)
+			put(*out, *a);
+		for (; b != bEnd; ++b, ++out)
+			put(*out, *b);
+	}
+
+  public:
+	template <size_t BlockSize>
+	run_sorter(deque<T, BlockSize> &d, Compare c) : total(0), comp(c)
+	{
+		d.compact();
+		d.for_each_segment([&](T *first, T *last) {
+			runs.push_back(Run(first, last));
+			starts.push_back(total);
+			total += last - first;
+		});
+		starts.push_back(total);
+		runs.push_back(Run(NULL, NULL));
+	}
+
+	void sort(bool stable, thread_pool &pool)
+	{
+		size_t count = runs.size() - 1;
+		pool.run(count, [&](size_t i) {
+			if (stable)
+				std::stable_sort(runs[i].first, runs[i].second, comp);
+			else
+				std::sort(runs[i].first, runs[i].second, comp);
+		});
+		if (count < 2)
+			return;
+		Scratch scratch(total);
+		T *buffer = scratch.data;
+		for (size_t i = 0; i < count; i += 2)
+		{
+			scratch.from.push_back(starts[i]);
+			scratch.built.push_back(0);
+		}
+		bool inBuffer = false;
+		for (size_t w = 1; w < count; w *= 2, inBuffer = !inBuffer)
+		{
+			pool.run((count + 2 * w - 1) / (2 * w), [&](size_t k) {
+				size_t i = k * 2 * w;
+				size_t lo = starts[i], mid = starts[std::min(i + w, count)], hi = starts[std::min(i + 2 * w, count)];
+				if (inBuffer)
+					merge(buffer + lo, buffer + mid, buffer + mid, buffer + hi, at(lo), Assign());
+				else if (w == 1) //the first pass fills the raw buffer
+					merge(at(lo), at(mid), at(mid), at(hi), buffer + lo, Construct(&scratch.built[k]));
+				else
+					merge(at(lo), at(mid), at(mid), at(hi), buffer + lo, Assign());
+			});
+		}
+		if (inBuffer)
+			pool.run(count, [&](size_t i) {
+				T *src = buffer + starts[i];
+				for (T *p = runs[i].first; p != runs[i].second; ++p, ++src)
+					*p = std::move(*src);
+			});
+	}
+};
+
+template <class T, size_t BlockSize, class Compare = std::less<T> >
+void sort(deque<T, BlockSize> &d, Compare comp = Compare(), thread_pool &pool = default_thread_pool())
+{
+	run_sorter<T, Compare>(d, comp).sort(false, pool);
+}
+
+template <class T, size_t BlockSize, class Compare = std::less<T> >
+void stable_sort(deque<T, BlockSize> &d, Compare comp = Compare(), thread_pool &pool = default_thread_pool())
+{
+	run_sorter<T, Compare>(d, comp).sort(true, pool);
+}
+
+} // namespace sjtu
+
+#endif
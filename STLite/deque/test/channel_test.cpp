@@ -0,0 +1,116 @@
+/*
+ * Moves a move-only type through channel: by threads with push, pop and pop_n, and,
+ * when built as C++20, by coroutines with push_async and co_await pop, both when the
+ * element is already queued and when it is handed to a suspended coroutine. Every
+ * value must arrive exactly once, and nothing may be copied, which the type enforces.
+ *
+ *   g++ -std=c++11 -O2 -pthread channel_test.cpp
+ *   g++ -std=c++20 -O2 -pthread channel_test.cpp
+ */
+#include "../channel.hpp"
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+typedef std::unique_ptr<long> item;
+
+bool check(const std::vector<int> &seen, const char *what)
+{
+	for (size_t i = 0; i < seen.size(); ++i)
+		if (seen[i] != 1)
+		{
+			std::printf("%s: value %zu arrived %d times\n", what, i, seen[i]);
+			return false;
+		}
+	std::printf("%s: %zu values\n", what, seen.size());
+	return true;
+}
+
+bool threads(long count)
+{
+	sjtu::channel<item> ch(16);
+	std::vector<int> seen(count, 0);
+	std::thread producer([&]() {
+		for (long i = 0; i < count; ++i)
+		{
+			item x(new long(i));
+			ch.push(std::move(x));
+		}
+		ch.close();
+	});
+	item buf[7];
+	for (long i = 0;; ++i)
+		if (i & 1)
+		{
+			size_t n = ch.pop_n(buf, 7);
+			if (n == 0)
+				break;
+			for (size_t j = 0; j < n; ++j)
+				++seen[*buf[j]];
+		}
+		else
+		{
+			item x;
+			if (!ch.pop(x))
+				break;
+			++seen[*x];
+		}
+	producer.join();
+	return check(seen, "threads");
+}
+
+#ifdef SJTU_CHANNEL_COROUTINES
+struct task //runs eagerly and frees its frame when it finishes
+{
+	struct promise_type
+	{
+		task get_return_object() { return task(); }
+		std::suspend_never initial_suspend() { return std::suspend_never(); }
+		std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+task produce(sjtu::channel<item> &ch, long from, long to)
+{
+	for (long i = from; i < to; ++i)
+		co_await ch.push_async(item(new long(i)));
+}
+task consume(sjtu::channel<item> &ch, std::vector<int> &seen)
+{
+	for (;;)
+	{
+		std::optional<item> x = co_await ch.pop();
+		if (!x)
+			break;
+		++seen[**x];
+	}
+}
+
+bool coroutines(long count)
+{
+	std::vector<int> seen(count, 0);
+	{
+		sjtu::channel<item> ch(4);
+		produce(ch, 0, count / 2); //fills the channel and suspends
+		consume(ch, seen);         //takes queued elements, then waits and is handed the rest
+		produce(ch, count / 2, count);
+		ch.close();
+	}
+	return check(seen, "coroutines");
+}
+#endif
+
+int main()
+{
+	if (!threads(100000))
+		return 1;
+#ifdef SJTU_CHANNEL_COROUTINES
+	if (!coroutines(10000))
+		return 1;
+#endif
+	std::puts("ok");
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Throughput of concurrent_queue against a deque behind a mutex. For each shape of
+ * producers and consumers, the producers push the given number of values each, one
+ * at a time and then in batches of 64, and the consumers pop them all; prints
+ * millions of values per second. The shapes need as many cores as threads to say
+ * anything about contention, so the number of hardware threads is printed first.
+ *
+ *   g++ -std=c++11 -O2 -pthread concurrent_queue_bench.cpp
+ *   ./a.out [values per producer = 1000000]
+ */
+#include "../concurrent_queue.hpp"
+#include "../deque.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class locked_deque //the baseline: every operation takes the lock
+{
+	std::mutex lock;
+	sjtu::deque<size_t> items;
+
+  public:
+	void push(size_t x)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		items.push_back(x);
+	}
+	void push_n(const size_t *src, size_t n)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		items.append(src, n);
+	}
+	bool pop(size_t &out)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (items.empty())
+			return false;
+		out = items.front();
+		items.pop_front();
+		return true;
+	}
+	size_t pop_n(size_t *dst, size_t n)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		size_t k = n < items.size() ? n : items.size();
+		for (size_t i = 0; i < k; ++i)
+			dst[i] = items[i];
+		items.pop_front_n(k);
+		return k;
+	}
+};
+
+const size_t Batch = 64;
+
+template <class Queue>
+double run(size_t producers, size_t consumers, size_t count, bool batched) //M values per second
+{
+	Queue q;
+	std::atomic<size_t> popped(0);
+	std::vector<std::thread> pool;
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	for (size_t p = 0; p < producers; ++p)
+		pool.push_back(std::thread([&]() {
+			size_t buf[Batch];
+			for (size_t i = 0; i < count;)
+				if (batched)
+				{
+					size_t k = count - i < Batch ? count - i : Batch;
+					for (size_t j = 0; j < k; ++j)
+						buf[j] = i + j;
+					q.push_n(buf, k);
+					i += k;
+				}
+				else
+					q.push(i++);
+		}));
+	for (size_t c = 0; c < consumers; ++c)
+		pool.push_back(std::thread([&]() {
+			size_t buf[Batch];
+			while (popped.load(std::memory_order_relaxed) < producers * count)
+			{
+				size_t n = batched ? q.pop_n(buf, Batch) : q.pop(buf[0]);
+				if (n)
+					popped += n;
+				else
+					std::this_thread::yield();
+			}
+		}));
+	for (size_t k = 0; k < pool.size(); ++k)
+		pool[k].join();
+	double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	return producers * count / sec / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+	size_t count = argc > 1 ? size_t(std::atol(argv[1])) : 1000000;
+	const size_t shapes[][2] = {{1, 1}, {2, 2}, {4, 4}, {8, 8}, {1, 8}, {8, 1}};
+	std::printf("%u hardware threads\n", std::thread::hardware_concurrency());
+	std::printf("producers consumers  batch  concurrent_queue  locked deque (M values/s)\n");
+	for (int batched = 0; batched < 2; ++batched)
+		for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); ++i)
+		{
+			size_t p = shapes[i][0], c = shapes[i][1];
+			double lockFree = run<sjtu::concurrent_queue<size_t> >(p, c, count, batched != 0);
+			double locked = run<locked_deque>(p, c, count, batched != 0);
+			std::printf("%9zu %9zu %6zu %17.2f %13.2f\n", p, c, batched ? Batch : size_t(1), lockFree, locked);
+		}
+	return 0;
+}
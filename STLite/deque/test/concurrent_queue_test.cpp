@@ -0,0 +1,160 @@
+/*
+ * Stress test for concurrent_queue. Producers push tagged values singly and in
+ * batches while consumers pop singly and in batches; every value must come out exactly
+ * once, and the single pushes of one producer must reach each consumer in order. Then
+ * short-lived threads come and go over two queues of the same type, some exiting
+ * before and some after their queue is destroyed, to exercise the per-thread records.
+ *
+ *   g++ -std=c++11 -O2 -pthread -fsanitize=thread concurrent_queue_test.cpp
+ *   g++ -std=c++11 -O1 -pthread -fsanitize=address,undefined concurrent_queue_test.cpp
+ */
+#include "../concurrent_queue.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+typedef unsigned long long value_t; //producer << 40 | batch flag << 39 | sequence number
+const value_t BatchFlag = value_t(1) << 39;
+const value_t SeqMask = BatchFlag - 1;
+
+bool mpmc(size_t producers, size_t consumers, size_t count)
+{
+	sjtu::concurrent_queue<value_t> q;
+	std::atomic<size_t> popped(0);
+	std::vector<std::vector<value_t> > got(consumers);
+	std::vector<std::thread> pool;
+	for (size_t p = 0; p < producers; ++p)
+		pool.push_back(std::thread([&, p]() {
+			value_t batch[37];
+			for (size_t i = 0; i < count;)
+			{
+				value_t v = value_t(p) << 40 | i;
+				if (i % 5 == 4 && i + 37 <= count)
+				{
+					for (size_t j = 0; j < 37; ++j)
+						batch[j] = (v + j) | BatchFlag;
+					q.push_n(batch, 37);
+					i += 37;
+				}
+				else
+				{
+					if (i & 1)
+						q.push(v);
+					else
+						q.push(value_t(v));
+					++i;
+				}
+			}
+		}));
+	for (size_t c = 0; c < consumers; ++c)
+		pool.push_back(std::thread([&, c]() {
+			value_t buf[29];
+			while (popped.load(std::memory_order_relaxed) < producers * count)
+			{
+				size_t n = c & 1 ? q.pop_n(buf, 29) : q.pop(buf[0]);
+				got[c].insert(got[c].end(), buf, buf + n);
+				popped += n;
+			}
+		}));
+	for (size_t k = 0; k < pool.size(); ++k)
+		pool[k].join();
+	if (!q.empty())
+	{
+		std::printf("%zu/%zu: queue not empty after all values were popped\n", producers, consumers);
+		return false;
+	}
+
+	std::vector<unsigned char> seen(producers * count, 0);
+	for (size_t c = 0; c < consumers; ++c)
+	{
+		std::vector<value_t> last(producers, 0); //1 + the last single push seen from each producer
+		for (size_t i = 0; i < got[c].size(); ++i)
+		{
+			value_t v = got[c][i];
+			size_t p = size_t(v >> 40), seq = size_t(v & SeqMask);
+			if (p >= producers || seq >= count || seen[p * count + seq]++)
+			{
+				std::printf("%zu/%zu: value %llx popped twice or never pushed\n", producers, consumers, v);
+				return false;
+			}
+			if (!(v & BatchFlag))
+			{
+				if (seq + 1 <= last[p])
+				{
+					std::printf("%zu/%zu: producer %zu out of order\n", producers, consumers, p);
+					return false;
+				}
+				last[p] = seq + 1;
+			}
+		}
+	}
+	for (size_t i = 0; i < seen.size(); ++i)
+		if (!seen[i])
+		{
+			std::printf("%zu/%zu: value %zu lost\n", producers, consumers, i);
+			return false;
+		}
+	std::printf("%zu producers, %zu consumers: %zu values\n", producers, consumers, producers * count);
+	return true;
+}
+
+bool churn(size_t rounds)
+{
+	sjtu::concurrent_queue<value_t> *a = new sjtu::concurrent_queue<value_t>, *b = new sjtu::concurrent_queue<value_t>;
+	std::atomic<bool> go(false);
+	std::thread late([&]() { //holds a record of a until after a is destroyed
+		a->push(1);
+		while (!go.load())
+			std::this_thread::yield();
+	});
+	std::atomic<size_t> pops(0);
+	for (size_t r = 0; r < rounds; ++r)
+	{
+		std::vector<std::thread> pool;
+		for (size_t k = 0; k < 4; ++k)
+			pool.push_back(std::thread([&, k]() {
+				value_t x;
+				for (size_t i = 0; i < 300; ++i) //alternates between the queues
+				{
+					(i & 1 ? a : b)->push(i);
+					if (k & 1 && (i & 2 ? a : b)->pop(x))
+						++pops;
+				}
+			}));
+		for (size_t k = 0; k < pool.size(); ++k)
+			pool[k].join();
+	}
+	size_t total = 1 + rounds * 4 * 300 - pops.load();
+	size_t left = 0;
+	value_t x;
+	while (a->pop(x) || b->pop(x))
+		++left;
+	delete a; //this thread frees its record of a when a lookup passes over it or when it exits
+	b->push(2);
+	delete b;
+	go.store(true);
+	late.join();
+	if (left != total)
+	{
+		std::printf("churn: %zu values left, %zu expected\n", left, total);
+		return false;
+	}
+	std::printf("churn: %zu rounds of 4 threads\n", rounds);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	size_t count = argc > 1 ? size_t(std::atol(argv[1])) : 200000;
+	size_t rounds = argc > 2 ? size_t(std::atol(argv[2])) : 200;
+	const size_t shapes[][2] = {{1, 1}, {1, 4}, {4, 1}, {2, 2}, {4, 4}, {8, 8}};
+	for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); ++i)
+		if (!mpmc(shapes[i][0], shapes[i][1], count))
+			return 1;
+	if (!churn(rounds))
+		return 1;
+	std::puts("ok");
+	return 0;
+}
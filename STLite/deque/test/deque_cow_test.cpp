@@ -0,0 +1,146 @@
+/*
+ * Copy-on-write snapshots handed to other threads. The owner keeps writing its deque
+ * and takes a snapshot every round; reader threads sum, write and destroy the
+ * snapshots while the owner drops and detaches the blocks they share. Every snapshot
+ * must still hold what the deque held when it was taken, and the element count
+ * checks that each element is destroyed exactly once.
+ *
+ *   g++ -std=c++11 -O2 -pthread -fsanitize=thread deque_cow_test.cpp
+ *   g++ -std=c++11 -O1 -pthread -fsanitize=address,undefined deque_cow_test.cpp
+ */
+#include "../deque.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+std::atomic<long> alive(0);
+
+struct counted //not trivially copyable, so blocks are copied element by element
+{
+	long v;
+	counted(long x = 0) : v(x) { ++alive; }
+	counted(const counted &o) : v(o.v) { ++alive; }
+	counted &operator=(const counted &o)
+	{
+		v = o.v;
+		return *this;
+	}
+	~counted() { --alive; }
+};
+
+typedef sjtu::deque<counted, 32> cow_deque;
+
+struct snapshot
+{
+	cow_deque *d;
+	long sum; //of the deque when the snapshot was taken
+};
+
+class mailbox //hands snapshots from the owner to the readers
+{
+	std::mutex lock;
+	std::condition_variable ready;
+	std::vector<snapshot> items;
+	bool closed;
+
+  public:
+	mailbox() : closed(false) {}
+	void put(const snapshot &s)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		items.push_back(s);
+		ready.notify_one();
+	}
+	bool take(snapshot &s)
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		while (items.empty() && !closed)
+			ready.wait(guard);
+		if (items.empty())
+			return false;
+		s = items.back();
+		items.pop_back();
+		return true;
+	}
+	void close()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		closed = true;
+		ready.notify_all();
+	}
+};
+
+long total(const cow_deque &d)
+{
+	long s = 0;
+	for (cow_deque::const_iterator it = d.cbegin(); it != d.cend(); ++it)
+		s += it->v;
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	size_t rounds = argc > 1 ? size_t(std::atol(argv[1])) : 2000;
+	size_t readers = argc > 2 ? size_t(std::atol(argv[2])) : 3;
+	std::atomic<size_t> bad(0);
+	{
+		mailbox box;
+		std::vector<std::thread> pool;
+		for (size_t k = 0; k < readers; ++k)
+			pool.push_back(std::thread([&, k]() {
+				snapshot s;
+				while (box.take(s))
+				{
+					if (total(*s.d) != s.sum)
+						++bad;
+					if (k & 1 && !s.d->empty()) //a write detaches the snapshot's block on this thread
+					{
+						s.d->pop_back();
+						s.d->push_front(counted(1));
+					}
+					delete s.d;
+				}
+			}));
+
+		cow_deque d;
+		d.set_copy_on_write(true);
+		long sum = 0;
+		for (long i = 0; i < 1000; ++i)
+		{
+			d.push_back(counted(i));
+			sum += i;
+		}
+		for (size_t r = 0; r < rounds; ++r)
+		{
+			snapshot s = {new cow_deque(d), sum};
+			box.put(s);
+			for (size_t i = 0; i < 40; ++i) //pops whole blocks and writes into shared ones
+			{
+				sum -= d.front().v;
+				d.pop_front();
+				long x = long(r * 40 + i);
+				d.push_back(counted(x));
+				sum += x;
+			}
+			size_t at = r * 7 % d.size();
+			sum += 3 - d[at].v;
+			d[at] = counted(3);
+		}
+		box.close();
+		for (size_t k = 0; k < pool.size(); ++k)
+			pool[k].join();
+		if (total(d) != sum)
+			++bad;
+	}
+	if (bad.load() || alive.load())
+	{
+		std::printf("%zu snapshots changed, %ld elements not destroyed\n", bad.load(), alive.load());
+		return 1;
+	}
+	std::printf("%zu snapshots read by %zu threads\nok\n", rounds, readers);
+	return 0;
+}
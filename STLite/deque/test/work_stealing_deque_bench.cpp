@@ -0,0 +1,74 @@
+/*
+ * Throughput of work_stealing_deque across thread counts. One owner pushes tasks in
+ * batches and runs them from the bottom, the other threads steal them from the top;
+ * each task spins for a given number of steps. Prints tasks per second and the share
+ * that was stolen, for 1, 2, 4, ... threads up to the given maximum.
+ *
+ *   g++ -std=c++11 -O2 -pthread work_stealing_deque_bench.cpp
+ *   ./a.out [tasks = 4000000] [work per task = 64] [max threads = hardware threads]
+ */
+#include "../work_stealing_deque.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+typedef sjtu::work_stealing_deque<size_t> task_deque;
+
+static size_t work(size_t task, size_t steps) //stands in for running the task
+{
+	size_t h = task;
+	for (size_t i = 0; i < steps; ++i)
+		h = h * 6364136223846793005ULL + 1442695040888963407ULL;
+	return h;
+}
+
+int main(int argc, char **argv)
+{
+	size_t count = argc > 1 ? size_t(std::atol(argv[1])) : 4000000;
+	size_t steps = argc > 2 ? size_t(std::atol(argv[2])) : 64;
+	size_t maxThreads = argc > 3 ? size_t(std::atol(argv[3])) : std::thread::hardware_concurrency();
+	if (maxThreads == 0)
+		maxThreads = 1;
+	const size_t Batch = 256;
+	std::atomic<size_t> sink(0); //results of the work, printed so that it is not optimized away
+
+	for (size_t threads = 1; threads <= maxThreads; threads *= 2)
+	{
+		task_deque q;
+		std::atomic<bool> done(false);
+		std::atomic<size_t> stolen(0);
+		std::vector<std::thread> pool;
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		for (size_t k = 1; k < threads; ++k)
+			pool.push_back(std::thread([&]() {
+				size_t x, n = 0, h = 0;
+				while (!done.load(std::memory_order_acquire))
+					if (q.steal(x))
+					{
+						h += work(x, steps);
+						++n;
+					}
+				stolen += n;
+				sink += h;
+			}));
+		size_t x, h = 0;
+		for (size_t next = 0; next < count;)
+		{
+			for (size_t i = 0; i < Batch && next < count; ++i)
+				q.push(next++);
+			while (q.pop(x))
+				h += work(x, steps);
+		}
+		done.store(true, std::memory_order_release);
+		for (size_t k = 0; k < pool.size(); ++k)
+			pool[k].join();
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+		sink += h;
+		std::printf("%2zu threads: %8.2f M tasks/s, %5.1f%% stolen\n", threads, count / sec / 1e6, 100.0 * stolen.load() / count);
+	}
+	std::printf("checksum %zx\n", sink.load());
+	return 0;
+}
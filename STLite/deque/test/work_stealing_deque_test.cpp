@@ -0,0 +1,85 @@
+/*
+ * Stress test for work_stealing_deque: one owner pushes and pops, several thieves
+ * steal, and every task must come out exactly once. The owner pushes in bursts that
+ * outgrow the ring, so thieves also race with the ring being replaced.
+ *
+ *   g++ -std=c++11 -O2 -pthread -fsanitize=thread work_stealing_deque_test.cpp
+ */
+#include "../work_stealing_deque.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+typedef sjtu::work_stealing_deque<size_t> task_deque;
+
+bool run(size_t thieves, size_t count)
+{
+	task_deque q;
+	std::vector<std::vector<size_t> > taken(thieves + 1); //by the owner, then by each thief
+	std::atomic<bool> done(false);
+	std::vector<std::thread> pool;
+	for (size_t k = 0; k < thieves; ++k)
+		pool.push_back(std::thread([&, k]() {
+			size_t x;
+			while (!done.load(std::memory_order_acquire))
+				if (q.steal(x))
+					taken[k + 1].push_back(x);
+		}));
+
+	unsigned seed = unsigned(thieves) * 7919 + 1;
+	size_t x;
+	for (size_t next = 0; next < count;)
+	{
+		seed = seed * 1103515245 + 12345;
+		size_t burst = seed >> 16 & 4095; //up to eight times the first ring
+		for (; burst && next < count; --burst)
+			q.push(next++);
+		seed = seed * 1103515245 + 12345;
+		for (size_t pops = seed >> 16 & 2047; pops && q.pop(x); --pops)
+			taken[0].push_back(x);
+	}
+	while (q.pop(x)) //false once it is empty, even if a thief won the last task
+		taken[0].push_back(x);
+	done.store(true, std::memory_order_release);
+	for (size_t k = 0; k < thieves; ++k)
+		pool[k].join();
+
+	std::vector<unsigned char> seen(count, 0);
+	size_t total = 0, stolen = 0;
+	for (size_t k = 0; k <= thieves; ++k)
+	{
+		total += taken[k].size();
+		if (k)
+			stolen += taken[k].size();
+		for (size_t i = 0; i < taken[k].size(); ++i)
+		{
+			size_t t = taken[k][i];
+			if (t >= count || seen[t]++)
+			{
+				std::printf("%zu thieves: task %zu taken twice or out of range\n", thieves, t);
+				return false;
+			}
+		}
+	}
+	if (total != count)
+	{
+		std::printf("%zu thieves: %zu of %zu tasks taken\n", thieves, total, count);
+		return false;
+	}
+	std::printf("%zu thieves: %zu tasks, %zu stolen\n", thieves, count, stolen);
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	size_t count = argc > 1 ? size_t(std::atol(argv[1])) : 1000000;
+	size_t maxThieves = argc > 2 ? size_t(std::atol(argv[2])) : 8;
+	for (size_t thieves = 1; thieves <= maxThieves; thieves *= 2)
+		for (int round = 0; round < 3; ++round)
+			if (!run(thieves, count))
+				return 1;
+	std::puts("ok");
+	return 0;
+}
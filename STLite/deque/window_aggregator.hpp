@@ -0,0 +1,97 @@
+#ifndef SJTU_WINDOW_AGGREGATOR_HPP
+#define SJTU_WINDOW_AGGREGATOR_HPP
+
+#include "deque.hpp"
+#include <cstddef>
+#include <functional>
+
+namespace sjtu
+{
+/*
+ * Sliding window with an O(1) aggregate, for any associative op (sum, min, max,
+ * gcd, matrix product, ...); op need not be commutative nor have an identity. This
+ * is the two-stack queue: the window is split into a front part, for which suffix
+ * aggregates are kept, and a back part, for which only the running aggregate is
+ * kept. pop_front takes from the front part; when that runs dry the back part is
+ * turned into it in one pass, so every element is folded a constant number of times
+ * and push_back, pop_front and query are O(1) amortized. T must be default
+ * constructible.
+ */
+template <class T, class Op = std::plus<T> >
+class window_aggregator
+{
+	deque<T> values; //the whole window, oldest first
+	deque<T> suffix; //suffix[i] = op(values[i], ..., values[suffix.size() - 1]), the front part
+	T backTotal; //op over the back part, values[suffix.size()] on; stale when that part is empty
+	Op op;
+
+	size_t backSize() const
+	{
+		return values.size() - suffix.size();
+	}
+	void flip() //the back part becomes the front part
+	{
+		typename deque<T>::const_iterator it = values.cend();
+		T acc = *--it;
+		suffix.push_front(acc);
+		while (it != values.cbegin())
+		{
+			acc = op(*--it, acc);
+			suffix.push_front(acc);
+		}
+	}
+
+  public:
+	explicit window_aggregator(Op o = Op()) : backTotal(), op(o) {}
+
+	void push_back(const T &value)
+	{
+		backTotal = backSize() ? op(backTotal, value) : value;
+		values.push_back(value);
+	}
+	void pop_front()
+	{
+		if (values.empty())
+			throw container_is_empty();
+		if (suffix.empty())
+			flip();
+		values.pop_front();
+		suffix.pop_front();
+	}
+	T query() const //op over the whole window in order
+	{
+		if (values.empty())
+			throw container_is_empty();
+		if (suffix.empty())
+			return backTotal;
+		if (backSize() == 0)
+			return suffix.front();
+		return op(suffix.front(), backTotal);
+	}
+
+	const T &front() const
+	{
+		return values.front();
+	}
+	const T &back() const
+	{
+		return values.back();
+	}
+	size_t size() const
+	{
+		return values.size();
+	}
+	bool empty() const
+	{
+		return values.empty();
+	}
+	void clear()
+	{
+		values.clear();
+		suffix.clear();
+	}
+};
+
+} // namespace sjtu
+
+#endif
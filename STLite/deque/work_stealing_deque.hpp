@@ -0,0 +1,136 @@
+#ifndef SJTU_WORK_STEALING_DEQUE_HPP
+#define SJTU_WORK_STEALING_DEQUE_HPP
+
+#include "deque.hpp"
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+namespace sjtu
+{
+/*
+ * Chase-Lev work-stealing deque (with the C11 memory orderings of Le et al.).
+ * One owner thread calls push and pop at the bottom, any number of thieves call
+ * steal at the top; none of them takes a lock. The elements live in a ring of
+ * power-of-two size, one deque block to start with, that doubles when full. A
+ * replaced ring stays allocated until the deque is destroyed because a thief may
+ * still be reading from it. T must be trivially copyable, typically a task pointer.
+ */
+template <class T>
+class work_stealing_deque
+{
+	static_assert(std::is_trivially_copyable<T>::value, "work_stealing_deque elements are copied racily and must be trivially copyable");
+
+	static constexpr size_t floorPow2(size_t x)
+	{
+		return x < 2 ? 1 : 2 * floorPow2(x / 2);
+	}
+
+	struct Ring
+	{
+		size_t mask;
+		std::atomic<T> *slots;
+		Ring *retired; //the ring this one replaced
+		explicit Ring(size_t cap) : mask(cap - 1), slots(new std::atomic<T>[cap]), retired(NULL) {}
+		~Ring() { delete[] slots; }
+		size_t capacity() const { return mask + 1; }
+		T get(ptrdiff_t i) const { return slots[size_t(i) & mask].load(std::memory_order_relaxed); }
+		void put(ptrdiff_t i, const T &x) { slots[size_t(i) & mask].store(x, std::memory_order_relaxed); }
+	};
+
+	/*
+	 * Thieves race for top, so it gets a cache line of its own, apart from bottom, which
+	 * the owner writes on every push and pop, and from whatever precedes the deque. new
+	 * honours the alignment from C++17 on.
+	 */
+	alignas(CACHE_LINE_BYTES) std::atomic<ptrdiff_t> top;
+	alignas(CACHE_LINE_BYTES) std::atomic<ptrdiff_t> bottom;
+	std::atomic<Ring *> ring;
+
+	Ring *grow(Ring *old, ptrdiff_t t, ptrdiff_t b) //owner only
+	{
+		Ring *r = new Ring(old->capacity() * 2);
+		for (ptrdiff_t i = t; i < b; ++i)
+			r->put(i, old->get(i));
+		r->retired = old;
+		ring.store(r, std::memory_order_release);
+		return r;
+	}
+
+  public:
+	work_stealing_deque() : top(0), bottom(0), ring(new Ring(floorPow2(deque_block_size<T>::value))) {}
+	work_stealing_deque(const work_stealing_deque &) = delete;
+	work_stealing_deque &operator=(const work_stealing_deque &) = delete;
+	~work_stealing_deque()
+	{
+		Ring *r = ring.load(std::memory_order_relaxed);
+		while (r)
+		{
+			Ring *old = r->retired;
+			delete r;
+			r = old;
+		}
+	}
+
+	void push(const T &x) //owner only
+	{
+		ptrdiff_t b = bottom.load(std::memory_order_relaxed);
+		ptrdiff_t t = top.load(std::memory_order_acquire);
+		Ring *r = ring.load(std::memory_order_relaxed);
+		if (b - t > ptrdiff_t(r->capacity()) - 1)
+			r = grow(r, t, b);
+		r->put(b, x);
+		std::atomic_thread_fence(std::memory_order_release);
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	bool pop(T &x) //owner only, takes the most recently pushed element
+	{
+		ptrdiff_t b = bottom.load(std::memory_order_relaxed) - 1;
+		Ring *r = ring.load(std::memory_order_relaxed);
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		ptrdiff_t t = top.load(std::memory_order_relaxed);
+		if (t > b) //empty
+		{
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return false;
+		}
+		x = r->get(b);
+		if (t == b) //the last element, race the thieves for it
+		{
+			bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+		return true;
+	}
+	bool steal(T &x) //any thread, takes the oldest element; false if empty or another thread won the race
+	{
+		ptrdiff_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		ptrdiff_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b)
+			return false;
+		Ring *r = ring.load(std::memory_order_acquire);
+		T res = r->get(t);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			return false;
+		x = res;
+		return true;
+	}
+
+	size_t size() const //a snapshot, exact only when no other thread is active
+	{
+		ptrdiff_t b = bottom.load(std::memory_order_relaxed);
+		ptrdiff_t t = top.load(std::memory_order_relaxed);
+		return b > t ? size_t(b - t) : 0;
+	}
+	bool empty() const
+	{
+		return size() == 0;
+	}
+};
+
+} // namespace sjtu
+
+#endif